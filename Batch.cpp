@@ -0,0 +1,133 @@
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+#include "Batch.h"
+
+static std::string jsonString(const std::string& s) {
+	std::string out = "\"";
+	for (unsigned char c : s) {
+		switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (c < 0x20) {
+					char escaped[7];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					out += escaped;
+				} else {
+					out += c;
+				}
+		}
+	}
+	return out + "\"";
+}
+
+Batch::Batch(std::vector<std::string> fileNames, const Parser& parser, const Runner& runner, ExecutionLimits limits)
+	: parser(parser), runner(runner), limits(limits) {
+	for (const std::string& fileName : fileNames) {
+		Script script;
+		script.fileName = fileName;
+		scripts.push_back(script);
+	}
+}
+
+void Batch::runScript(Script& script) const {
+	auto start = std::chrono::steady_clock::now();
+	//a fresh copy of everything, so that nothing a script does is seen by the others
+	Parser scriptParser = parser;
+	Runner scriptRunner = runner;
+	scriptRunner.output = [&script](const std::string& text) {
+		script.output += text;
+	};
+	scriptRunner.setLimits(limits);
+	std::ifstream inFile(script.fileName);
+	if (!inFile) {
+		script.error = "couldn't open the file";
+	} else {
+		try {
+			std::string line;
+			while (std::getline(inFile, line)) {
+				scriptRunner.run(scriptParser.lex(line));
+			}
+		} catch (std::exception &e) {
+			script.error = e.what();
+		}
+	}
+	script.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Batch::print(const Script& script, bool json) const {
+	if (json) {
+		printf("{\"file\": %s, \"output\": %s, \"error\": %s, \"milliseconds\": %.3f}\n",
+			jsonString(script.fileName).c_str(),
+			jsonString(script.output).c_str(),
+			script.error.empty() ? "null" : jsonString(script.error).c_str(),
+			script.milliseconds);
+	} else {
+		fwrite(script.output.data(), 1, script.output.size(), stdout);
+		if (!script.error.empty()) {
+			//the same as running the file on its own
+			printf("%s nonexistant or unopenable.\n", script.fileName.c_str());
+			printf("Error: %s\n", script.error.c_str());
+		}
+	}
+	fflush(stdout);
+}
+
+int Batch::run(unsigned int jobs, bool json) {
+	auto start = std::chrono::steady_clock::now();
+	//the workers take the next script that nobody has started, and mark it finished when they're done
+	std::atomic<size_t> next(0);
+	std::vector<bool> finished(scripts.size(), false);
+	std::mutex finishedMutex;
+	std::condition_variable finishedChanged;
+	std::vector<std::thread> pool;
+	for (unsigned int n = 0; n < std::min<size_t>(jobs, scripts.size()); n++) {
+		pool.emplace_back([&]() {
+			size_t index;
+			while ((index = next++) < scripts.size()) {
+				runScript(scripts[index]);
+				std::lock_guard<std::mutex> lock(finishedMutex);
+				finished[index] = true;
+				finishedChanged.notify_all();
+			}
+		});
+	}
+	//print them in order as soon as they (and everything before them) are done
+	for (size_t index = 0; index < scripts.size(); index++) {
+		{
+			std::unique_lock<std::mutex> lock(finishedMutex);
+			finishedChanged.wait(lock, [&]() { return finished[index]; });
+		}
+		print(scripts[index], json);
+		//(nobody needs it after this, and there could be thousands of them)
+		std::string().swap(scripts[index].output);
+	}
+	for (std::thread& worker : pool) {
+		worker.join();
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	unsigned long long failures = 0;
+	double scriptMilliseconds = 0;
+	fprintf(stderr, "Ran %zu scripts with %u jobs:\n", scripts.size(), jobs);
+	for (const Script& script : scripts) {
+		fprintf(stderr, "    %s: %.3f ms%s\n", script.fileName.c_str(), script.milliseconds, script.error.empty() ? "" : " (failed)");
+		scriptMilliseconds += script.milliseconds;
+		if (!script.error.empty()) {
+			failures++;
+		}
+	}
+	fprintf(stderr, "%llu failed. %.3f ms in the scripts, %.3f ms in total.\n", failures, scriptMilliseconds, milliseconds);
+	return failures > 0 ? -1 : 0;
+}
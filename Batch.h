@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Parser.h"
+#include "Runner.h"
+
+//`charm -j <count> a.charm b.charm ...` runs every input file in its own copy of a parser and a runner
+//with the prelude already loaded, <count> at a time. what each one writes is held on to and printed
+//in the order the files were given (or as one JSON object per file with --json), followed by a summary
+class Batch {
+private:
+	struct Script {
+		std::string fileName;
+		std::string output;
+		//empty if the script ran to the end
+		std::string error;
+		double milliseconds = 0;
+	};
+	std::vector<Script> scripts;
+	//everything the scripts start from. these are only ever copied once the batch is running
+	const Parser parser;
+	const Runner runner;
+	ExecutionLimits limits;
+
+	void runScript(Script& script) const;
+	void print(const Script& script, bool json) const;
+public:
+	Batch(std::vector<std::string> fileNames, const Parser& parser, const Runner& runner, ExecutionLimits limits);
+	//returns the exit code: -1 if any of the scripts failed
+	int run(unsigned int jobs, bool json);
+};
@@ -0,0 +1,52 @@
+#include <string>
+#include <sstream>
+
+#include "Charm.h"
+#include "Parser.h"
+#include "Runner.h"
+#include "PredefinedFunctions.h"
+#include "Prelude.charm.h"
+
+CharmProgram::CharmProgram(const std::string& source, const std::vector<NativeBuiltin>& builtins) : parser(new Parser()) {
+	fA = parser->getFunctionAnalyzer();
+	//(the runners made from this one share its builtins, and the analyzer has to know
+	//about them before anything that calls them gets analyzed)
+	for (const NativeBuiltin& builtin : builtins) {
+		prototype.pF->addBuiltinFunction(builtin.name, builtin.f, false);
+		fA->addBuiltinFunction(builtin.name, builtin.f);
+	}
+	prototype.run(parser->lex(prelude));
+	std::string line;
+	std::stringstream in(source);
+	while (std::getline(in, line)) {
+		CHARM_LIST_TYPE parsedLine = parser->lex(line).first;
+		//define everything up front, so that call() works without run()
+		CHARM_LIST_TYPE definitions;
+		for (const CharmFunction& f : parsedLine) {
+			if (f.functionType == FUNCTION_DEFINITION) {
+				definitions.push_back(f);
+			}
+		}
+		prototype.run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>(definitions, fA));
+		lines.push_back(parsedLine);
+	}
+	//so that the runners made from this one share the definitions instead of copying them
+	prototype.freezeDefinitions();
+}
+
+CharmProgram::~CharmProgram() {}
+
+Runner CharmProgram::instantiate() const {
+	//(safe to call from any number of threads, nothing in the prototype changes)
+	return prototype;
+}
+
+void CharmProgram::run(Runner& r) const {
+	for (const CHARM_LIST_TYPE& line : lines) {
+		r.run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>(line, fA));
+	}
+}
+
+void CharmProgram::call(Runner& r, const std::string& fName) const {
+	r.run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>({ charmCall(fName) }, fA));
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "ParserTypes.h"
+#include "Runner.h"
+
+//the embedding API, built into libcharm (`make libcharm.a` or `make libcharm.so`).
+//a script gets compiled once into a CharmProgram, and then every use of it gets
+//its own Runner from instantiate(), which is cheap: nothing is parsed again
+
+//In Parser.h
+class Parser;
+
+//a builtin written in C++ by whoever is embedding charm. it works on the
+//runner's current stack, like the builtins in PredefinedFunctions.cpp
+struct NativeBuiltin {
+	std::string name;
+	std::function<void(Runner*)> f;
+};
+
+class CharmProgram {
+private:
+	std::unique_ptr<Parser> parser;
+	FunctionAnalyzer* fA;
+	//the top level of the script, line by line
+	std::vector<CHARM_LIST_TYPE> lines;
+	//has the prelude and the script's definitions in it, and gets copied by instantiate()
+	Runner prototype;
+public:
+	//parse the prelude and the script. dies if either doesn't parse
+	CharmProgram(const std::string& source, const std::vector<NativeBuiltin>& builtins = {});
+	~CharmProgram();
+	CharmProgram(const CharmProgram&) = delete;
+	CharmProgram& operator=(const CharmProgram&) = delete;
+
+	//a fresh runner that knows every definition in the script, with empty stacks and refs.
+	//the runners share the definitions and builtins (read-only), so each one can be run
+	//on its own thread, and redefining things in one doesn't change the others
+	Runner instantiate() const;
+	//run the top level of the script on r
+	void run(Runner& r) const;
+	//run a single function (a definition from the script or the prelude, or a builtin) on r
+	void call(Runner& r, const std::string& fName) const;
+};
+
+//values to push onto a runner's stack
+inline CharmFunction charmInteger(long long n) {
+	CharmFunction f = CharmFunction();
+	f.functionType = NUMBER_FUNCTION;
+	f.numberValue.whichType = INTEGER_VALUE;
+	f.numberValue.integerValue = n;
+	return f;
+}
+
+inline CharmFunction charmFloat(long double n) {
+	CharmFunction f = CharmFunction();
+	f.functionType = NUMBER_FUNCTION;
+	f.numberValue.whichType = FLOAT_VALUE;
+	f.numberValue.floatValue = n;
+	return f;
+}
+
+inline CharmFunction charmString(std::string s) {
+	CharmFunction f = CharmFunction();
+	f.functionType = STRING_FUNCTION;
+	f.stringValue = s;
+	return f;
+}
+
+inline CharmFunction charmList(CHARM_LIST_TYPE fs) {
+	CharmFunction f = CharmFunction();
+	f.functionType = LIST_FUNCTION;
+	f.literalFunctions = fs;
+	return f;
+}
+
+//a call to a function, to put in lists
+inline CharmFunction charmCall(std::string fName) {
+	CharmFunction f = CharmFunction();
+	f.functionType = DEFINED_FUNCTION;
+	f.functionName = fName;
+	return f;
+}
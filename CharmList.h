@@ -0,0 +1,174 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <initializer_list>
+#include <cstddef>
+
+#include "CharmPool.h"
+
+//the payload of a LIST_FUNCTION (and the body of a definition): a vector that's shared between
+//copies until one of them gets changed, so that copying a list (onto the stack, into a definition)
+//doesn't copy what's in it. it also remembers its hash once something asks for it (see
+//charmFunctionHash), so that lists that have been compared before are told apart in O(1).
+//the non const functions make the payload this list's own before they return, so a reference
+//or iterator from one of them is only good until the list is copied (or changed) again.
+//the payloads, and the items in them, come from the CharmPool
+template <typename T>
+class CharmList {
+public:
+	typedef std::vector<T, CharmPoolAllocator<T>> vector_type;
+private:
+	struct Payload {
+		vector_type items;
+		//0 until somebody works it out (a hash that really is 0 just gets worked out every time)
+		mutable std::atomic<std::size_t> hash;
+		Payload() : hash(0) {}
+		Payload(const vector_type& items) : items(items), hash(0) {}
+	};
+	//null if the list is empty and nothing's been reserved
+	std::shared_ptr<Payload> payload;
+
+	//for anything that might change the items
+	static std::shared_ptr<Payload> makePayload() {
+		return std::allocate_shared<Payload>(CharmPoolAllocator<Payload>());
+	}
+	vector_type& writable() {
+		if (!payload) {
+			payload = makePayload();
+		} else if (payload.use_count() != 1) {
+			payload = std::allocate_shared<Payload>(CharmPoolAllocator<Payload>(), payload->items);
+		} else {
+			payload->hash.store(0, std::memory_order_relaxed);
+		}
+		return payload->items;
+	}
+	const vector_type& readable() const {
+		static const vector_type empty;
+		return payload ? payload->items : empty;
+	}
+public:
+	typedef T value_type;
+	typedef std::size_t size_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	CharmList() {}
+	CharmList(std::initializer_list<T> items) {
+		if (items.size() > 0) {
+			writable().assign(items.begin(), items.end());
+		}
+	}
+	template <typename Iterator>
+	CharmList(Iterator first, Iterator last) {
+		assign(first, last);
+	}
+
+	size_type size() const { return payload ? payload->items.size() : 0; }
+	bool empty() const { return size() == 0; }
+	//whether the two of them are the same payload, and so definitely equal
+	bool sharesWith(const CharmList& other) const { return payload == other.payload; }
+	//the hash of the items, worked out with hashItems(const vector_type&) the first time
+	template <typename HashItems>
+	std::size_t hash(HashItems hashItems) const {
+		if (!payload) {
+			return hashItems(readable());
+		}
+		std::size_t h = payload->hash.load(std::memory_order_relaxed);
+		if (h == 0) {
+			h = hashItems(payload->items);
+			payload->hash.store(h, std::memory_order_relaxed);
+		}
+		return h;
+	}
+
+	const T& operator[](size_type n) const { return payload->items[n]; }
+	T& operator[](size_type n) { return writable()[n]; }
+	const T& at(size_type n) const { return readable().at(n); }
+	T& at(size_type n) { return writable().at(n); }
+	const T& front() const { return payload->items.front(); }
+	T& front() { return writable().front(); }
+	const T& back() const { return payload->items.back(); }
+	T& back() { return writable().back(); }
+
+	const_iterator begin() const { return payload ? payload->items.data() : nullptr; }
+	const_iterator end() const { return begin() + size(); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+	iterator begin() {
+		if (empty()) return nullptr;
+		return writable().data();
+	}
+	iterator end() { return begin() + size(); }
+
+	void push_back(const T& item) { writable().push_back(item); }
+	void push_back(T&& item) { writable().push_back(std::move(item)); }
+	template <typename... Args>
+	T& emplace_back(Args&&... args) { return writable().emplace_back(std::forward<Args>(args)...); }
+	void pop_back() { writable().pop_back(); }
+	void reserve(size_type n) { writable().reserve(n); }
+	void resize(size_type n) { writable().resize(n); }
+	void clear() { payload.reset(); }
+	void swap(CharmList& other) { payload.swap(other.payload); }
+
+	//(positions are worked out before the payload is made this list's own, which can move it)
+	iterator insert(const_iterator position, const T& item) {
+		size_type n = position - cbegin();
+		vector_type& items = writable();
+		return &*items.insert(items.begin() + n, item);
+	}
+	template <typename Iterator>
+	iterator insert(const_iterator position, Iterator first, Iterator last) {
+		size_type n = position - cbegin();
+		if (first == last) {
+			return begin() + n;
+		}
+		vector_type& items = writable();
+		return &*items.insert(items.begin() + n, first, last);
+	}
+	iterator erase(const_iterator position) {
+		return erase(position, position + 1);
+	}
+	iterator erase(const_iterator first, const_iterator last) {
+		size_type from = first - cbegin();
+		size_type to = last - cbegin();
+		vector_type& items = writable();
+		items.erase(items.begin() + from, items.begin() + to);
+		return items.data() + from;
+	}
+	template <typename Iterator>
+	void assign(Iterator first, Iterator last) {
+		if (first == last) {
+			payload.reset();
+			return;
+		}
+		//(into a new payload, so that assigning part of itself to a list works)
+		auto assigned = makePayload();
+		assigned->items.assign(first, last);
+		payload = assigned;
+	}
+};
+
+template <typename T>
+bool operator==(const CharmList<T>& lhs, const CharmList<T>& rhs) {
+	if (lhs.sharesWith(rhs)) {
+		return true;
+	}
+	if (lhs.size() != rhs.size()) {
+		return false;
+	}
+	for (typename CharmList<T>::size_type n = 0; n < lhs.size(); n++) {
+		if (!(lhs[n] == rhs[n])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename T>
+bool operator!=(const CharmList<T>& lhs, const CharmList<T>& rhs) {
+	return !(lhs == rhs);
+}
@@ -0,0 +1,136 @@
+#include <mutex>
+
+#include "CharmPool.h"
+
+struct CharmPool::Pool {
+	//the free blocks of each size, linked together through their first few bytes
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+	FreeBlock* free[CLASSES] = {};
+	std::size_t kept = 0;
+	Statistics counted;
+	~Pool();
+};
+
+namespace {
+	//what the threads that have ended added up to (never destroyed, since
+	//a thread might end while the program's statics are being torn down)
+	struct Finished {
+		std::mutex mutex;
+		CharmPool::Statistics statistics;
+	};
+	Finished& finished() {
+		static Finished* f = new Finished();
+		return *f;
+	}
+	//set once this thread's pool is gone. it's trivially destructible, so it's still there for
+	//the blocks that get freed after that (by the destructors of statics, say), which go to the heap
+	thread_local bool poolDestroyed = false;
+	//see threadBytesInUse (trivially destructible too)
+	thread_local long long bytesInUse = 0;
+}
+
+CharmPool::Pool::~Pool() {
+	for (std::size_t c = 0; c < CLASSES; c++) {
+		while (free[c] != nullptr) {
+			FreeBlock* block = free[c];
+			free[c] = block->next;
+			::operator delete(block);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(finished().mutex);
+		finished().statistics.allocations += counted.allocations;
+		finished().statistics.reused += counted.reused;
+		finished().statistics.heapBytes += counted.heapBytes;
+	}
+	poolDestroyed = true;
+}
+
+CharmPool::Pool* CharmPool::threadPool() {
+	if (poolDestroyed) {
+		return nullptr;
+	}
+	thread_local Pool pool;
+	return &pool;
+}
+
+void* CharmPool::allocate(std::size_t bytes) {
+	Pool* pool = CharmPool::threadPool();
+	if (bytes == 0 || bytes > LARGEST) {
+		bytesInUse += bytes;
+		if (pool != nullptr) {
+			pool->counted.allocations++;
+			pool->counted.heapBytes += bytes;
+		}
+		return ::operator new(bytes);
+	}
+	//(always the whole size of the class, so that any thread can put it on a free list later)
+	std::size_t c = (bytes - 1) / GRANULE;
+	std::size_t size = (c + 1) * GRANULE;
+	bytesInUse += size;
+	if (pool == nullptr) {
+		return ::operator new(size);
+	}
+	pool->counted.allocations++;
+	if (pool->free[c] != nullptr) {
+		Pool::FreeBlock* block = pool->free[c];
+		pool->free[c] = block->next;
+		pool->kept -= size;
+		pool->counted.reused++;
+		return block;
+	}
+	pool->counted.heapBytes += size;
+	return ::operator new(size);
+}
+
+void CharmPool::deallocate(void* block, std::size_t bytes) {
+	if (block == nullptr) {
+		return;
+	}
+	Pool* pool = CharmPool::threadPool();
+	if (bytes == 0 || bytes > LARGEST) {
+		bytesInUse -= bytes;
+		::operator delete(block);
+		return;
+	}
+	std::size_t c = (bytes - 1) / GRANULE;
+	std::size_t size = (c + 1) * GRANULE;
+	bytesInUse -= size;
+	if (pool == nullptr) {
+		::operator delete(block);
+		return;
+	}
+	if (pool->kept + size > MAX_KEPT) {
+		::operator delete(block);
+		return;
+	}
+	Pool::FreeBlock* freed = static_cast<Pool::FreeBlock*>(block);
+	freed->next = pool->free[c];
+	pool->free[c] = freed;
+	pool->kept += size;
+}
+
+CharmPool::Statistics CharmPool::statistics() {
+	Statistics out;
+	{
+		std::lock_guard<std::mutex> lock(finished().mutex);
+		out = finished().statistics;
+	}
+	Pool* pool = CharmPool::threadPool();
+	if (pool != nullptr) {
+		out.allocations += pool->counted.allocations;
+		out.reused += pool->counted.reused;
+		out.heapBytes += pool->counted.heapBytes;
+	}
+	return out;
+}
+
+long long CharmPool::threadBytesInUse() {
+	return bytesInUse;
+}
+
+void CharmPool::charge(long long bytes) {
+	bytesInUse += bytes;
+}
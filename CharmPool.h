@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <new>
+
+//where the interpreter's small blocks come from: the nodes of the stacks, the payloads of lists
+//(and the vectors in them) and the pieces of strings, which get made and thrown away all the time.
+//a block that's freed goes on a free list for its size, belonging to the thread that freed it,
+//and the next block of that size made on that thread is taken from there instead of from malloc.
+//the free lists only hold so much, and what's in them is given back all at once when the thread ends
+class CharmPool {
+private:
+	//blocks are sized in steps of this, and anything bigger than LARGEST goes straight to the heap
+	static const std::size_t GRANULE = 16;
+	static const std::size_t LARGEST = 1024;
+	static const std::size_t CLASSES = LARGEST / GRANULE;
+	//the most each thread keeps on its free lists, all together
+	static const std::size_t MAX_KEPT = 1 << 20;
+	struct Pool;
+	static Pool* threadPool();
+public:
+	static void* allocate(std::size_t bytes);
+	//bytes has to be what the block was allocated with
+	static void deallocate(void* block, std::size_t bytes);
+
+	//how it's gone so far, for the whole program (threads that are still running only
+	//count once they end, except for the one that asks)
+	struct Statistics {
+		//blocks handed out, and how many of them came off a free list instead of the heap
+		unsigned long long allocations = 0;
+		unsigned long long reused = 0;
+		//the bytes that were taken from the heap
+		unsigned long long heapBytes = 0;
+	};
+	static Statistics statistics();
+
+	//the bytes this thread has allocated and not freed yet (less the ones it freed for other
+	//threads, so it's only meaningful for a thread that keeps to its own values). it's what
+	//a Runner's memory limit is checked against
+	static long long threadBytesInUse();
+	//count memory that comes from somewhere else against this thread (negative to give it back)
+	static void charge(long long bytes);
+};
+
+//for containers (and std::allocate_shared) whose blocks should come from the CharmPool
+template <typename T>
+struct CharmPoolAllocator {
+	typedef T value_type;
+	CharmPoolAllocator() noexcept {}
+	template <typename U>
+	CharmPoolAllocator(const CharmPoolAllocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n) {
+		static_assert(alignof(T) <= alignof(std::max_align_t), "CharmPool blocks are only aligned for ordinary types");
+		return static_cast<T*>(CharmPool::allocate(n * sizeof(T)));
+	}
+	void deallocate(T* block, std::size_t n) noexcept {
+		CharmPool::deallocate(block, n * sizeof(T));
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const CharmPoolAllocator<T>&, const CharmPoolAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const CharmPoolAllocator<T>&, const CharmPoolAllocator<U>&) { return false; }
@@ -0,0 +1,287 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#include "CharmString.h"
+#include "CharmPool.h"
+
+//pieces this small are copied into one piece when they're joined, instead of being linked
+//(so adding one character at a time doesn't make a node per character)
+static const size_t SMALL_PIECE = 256;
+
+CharmString::CharmString(const std::string& s) : CharmString(std::string(s)) {}
+
+CharmString::CharmString(std::string&& s) : root(leaf(std::move(s))) {}
+
+CharmString::CharmString(const char* s) : CharmString(std::string(s)) {}
+
+CharmString CharmString::character(char c) {
+	//(made once, and shared by every one character string after that)
+	static const std::vector<NodePtr> characters = []() {
+		std::vector<NodePtr> characters;
+		for (int n = 0; n < 256; n++) {
+			characters.push_back(leaf(std::string(1, static_cast<char>(n))));
+		}
+		return characters;
+	}();
+	return CharmString(characters[static_cast<unsigned char>(c)]);
+}
+
+CharmString::NodePtr CharmString::leaf(std::string&& text) {
+	if (text.empty()) {
+		return nullptr;
+	}
+	auto node = std::allocate_shared<Node>(CharmPoolAllocator<Node>());
+	node->text = std::move(text);
+	node->data = node->text.data();
+	node->length = node->text.size();
+	//the text doesn't come from the pool, but it's the bulk of a big string
+	CharmPool::charge(node->text.capacity());
+	return node;
+}
+
+CharmString::Node::~Node() {
+	if (!text.empty()) {
+		CharmPool::charge(-(long long)text.capacity());
+	}
+}
+
+CharmString::NodePtr CharmString::leafSlice(const NodePtr& leaf, size_t pos, size_t length) {
+	if (length == 0) {
+		return nullptr;
+	}
+	auto node = std::allocate_shared<Node>(CharmPoolAllocator<Node>());
+	node->source = leaf->source ? leaf->source : leaf;
+	node->data = leaf->data + pos;
+	node->length = length;
+	return node;
+}
+
+CharmString::NodePtr CharmString::branch(NodePtr left, NodePtr right) {
+	auto node = std::allocate_shared<Node>(CharmPoolAllocator<Node>());
+	node->length = left->length + right->length;
+	node->depth = std::max(left->depth, right->depth) + 1;
+	node->left = left;
+	node->right = right;
+	return node;
+}
+
+//a copy of both of them, in one piece
+static std::string merge(const CharmString& left, const CharmString& right) {
+	std::string text;
+	text.reserve(left.size() + right.size());
+	auto append = [&text](const char* data, size_t size) {
+		text.append(data, size);
+		return true;
+	};
+	left.forEachChunk(append);
+	right.forEachChunk(append);
+	return text;
+}
+
+CharmString::NodePtr CharmString::join(NodePtr left, NodePtr right) {
+	if (!left) return right;
+	if (!right) return left;
+	if (left->length + right->length <= SMALL_PIECE) {
+		return leaf(merge(CharmString(left), CharmString(right)));
+	}
+	//appending (or prepending) a little bit at a time only ever copies the small piece on the end
+	if (right->isLeaf() && !left->isLeaf() && left->right->isLeaf() && left->right->length + right->length <= SMALL_PIECE) {
+		return branch(left->left, join(left->right, right));
+	}
+	if (left->isLeaf() && !right->isLeaf() && right->left->isLeaf() && left->length + right->left->length <= SMALL_PIECE) {
+		return branch(join(left, right->left), right->right);
+	}
+	if (left->depth > right->depth + 1) {
+		return joinRight(left, right);
+	}
+	if (right->depth > left->depth + 1) {
+		return joinLeft(left, right);
+	}
+	return branch(left, right);
+}
+
+//joining ropes of different depths hangs the shallow one off the side of the deep one, and
+//rotates on the way back up to keep it balanced like an AVL tree, so that it's O(log n)
+CharmString::NodePtr CharmString::rotateLeft(const NodePtr& node) {
+	return branch(branch(node->left, node->right->left), node->right->right);
+}
+
+CharmString::NodePtr CharmString::rotateRight(const NodePtr& node) {
+	return branch(node->left->left, branch(node->left->right, node->right));
+}
+
+CharmString::NodePtr CharmString::joinRight(const NodePtr& left, const NodePtr& right) {
+	//left is the deeper one
+	const NodePtr& outer = left->left;
+	const NodePtr& inner = left->right;
+	if (inner->depth <= right->depth + 1) {
+		NodePtr joined = branch(inner, right);
+		if (joined->depth <= outer->depth + 1) {
+			return branch(outer, joined);
+		}
+		return rotateLeft(branch(outer, rotateRight(joined)));
+	}
+	NodePtr joined = joinRight(inner, right);
+	NodePtr node = branch(outer, joined);
+	if (joined->depth <= outer->depth + 1) {
+		return node;
+	}
+	return rotateLeft(node);
+}
+
+CharmString::NodePtr CharmString::joinLeft(const NodePtr& left, const NodePtr& right) {
+	//right is the deeper one
+	const NodePtr& inner = right->left;
+	const NodePtr& outer = right->right;
+	if (inner->depth <= left->depth + 1) {
+		NodePtr joined = branch(left, inner);
+		if (joined->depth <= outer->depth + 1) {
+			return branch(joined, outer);
+		}
+		return rotateRight(branch(rotateLeft(joined), outer));
+	}
+	NodePtr joined = joinLeft(left, inner);
+	NodePtr node = branch(joined, outer);
+	if (joined->depth <= outer->depth + 1) {
+		return node;
+	}
+	return rotateRight(node);
+}
+
+CharmString::NodePtr CharmString::slice(const NodePtr& node, size_t pos, size_t length) {
+	if (!node || length == 0) {
+		return nullptr;
+	}
+	if (pos == 0 && length == node->length) {
+		return node;
+	}
+	if (node->isLeaf()) {
+		return leafSlice(node, pos, length);
+	}
+	size_t leftLength = node->left->length;
+	if (pos + length <= leftLength) {
+		return slice(node->left, pos, length);
+	}
+	if (pos >= leftLength) {
+		return slice(node->right, pos - leftLength, length);
+	}
+	return join(slice(node->left, pos, leftLength - pos), slice(node->right, 0, pos + length - leftLength));
+}
+
+char CharmString::operator[](size_t n) const {
+	const Node* node = root.get();
+	while (!node->isLeaf()) {
+		if (n < node->left->length) {
+			node = node->left.get();
+		} else {
+			n -= node->left->length;
+			node = node->right.get();
+		}
+	}
+	return node->data[n];
+}
+
+const std::string& CharmString::str() const {
+	static const std::string emptyString;
+	if (!root) {
+		return emptyString;
+	}
+	if (!root->isLeaf() || root->source) {
+		root = leaf(merge(*this, CharmString()));
+	}
+	return root->text;
+}
+
+CharmString CharmString::operator+(const CharmString& other) const {
+	return CharmString(join(root, other.root));
+}
+
+void CharmString::append(const CharmString& other) {
+	root = join(root, other.root);
+}
+
+void CharmString::insert(size_t pos, const CharmString& other) {
+	if (pos > size()) {
+		throw std::out_of_range("CharmString::insert");
+	}
+	root = join(join(slice(root, 0, pos), other.root), slice(root, pos, size() - pos));
+}
+
+CharmString CharmString::substr(size_t pos, size_t length) const {
+	if (pos > size()) {
+		throw std::out_of_range("CharmString::substr");
+	}
+	return CharmString(slice(root, pos, std::min(length, size() - pos)));
+}
+
+size_t CharmString::find(const std::string& pattern, size_t from) const {
+	if (from > size()) {
+		return std::string::npos;
+	}
+	if (pattern.empty()) {
+		return from;
+	}
+	//the last (pattern size - 1) characters before the piece being searched, where a match that
+	//starts in an earlier piece would have to start
+	std::string carry;
+	size_t carryStart = from;
+	size_t pieceStart = from;
+	size_t found = std::string::npos;
+	substr(from).forEachChunk([&](const char* data, size_t size) {
+		std::string window = carry;
+		window.append(data, std::min(size, pattern.size() - 1));
+		const char* match = static_cast<const char*>(memmem(window.data(), window.size(), pattern.data(), pattern.size()));
+		//(the ones that start in this piece are found below)
+		if (match != nullptr && (size_t)(match - window.data()) < carry.size()) {
+			found = carryStart + (match - window.data());
+			return false;
+		}
+		match = static_cast<const char*>(memmem(data, size, pattern.data(), pattern.size()));
+		if (match != nullptr) {
+			found = pieceStart + (match - data);
+			return false;
+		}
+		if (size >= pattern.size() - 1) {
+			carry.assign(data + size - (pattern.size() - 1), pattern.size() - 1);
+		} else {
+			carry.append(data, size);
+			if (carry.size() >= pattern.size()) {
+				carry.erase(0, carry.size() - (pattern.size() - 1));
+			}
+		}
+		pieceStart += size;
+		carryStart = pieceStart - carry.size();
+		return true;
+	});
+	return found;
+}
+
+size_t CharmString::hash() const {
+	const std::string& flat = str();
+	if (!root) {
+		return std::hash<std::string>()(flat);
+	}
+	size_t h = root->hash.load(std::memory_order_relaxed);
+	if (h == 0) {
+		h = std::hash<std::string>()(flat);
+		root->hash.store(h, std::memory_order_relaxed);
+	}
+	return h;
+}
+
+bool CharmString::operator==(const CharmString& other) const {
+	if (size() != other.size()) {
+		return false;
+	}
+	if (root == other.root) {
+		return true;
+	}
+	if (hash() != other.hash()) {
+		return false;
+	}
+	return str() == other.str();
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+//the payload of a STRING_FUNCTION: a rope, so that building a string out of lots of
+//little pieces (with concat and insert) doesn't copy the whole thing every time.
+//the pieces are immutable and shared between copies, so copying one is cheap too.
+//str() flattens it into one piece the first time something needs contiguous bytes.
+//only str() (and flatten()) change anything, so a CharmString that's read from more than
+//one thread at a time (like the literals in frozen definitions, which freezeDefinitions
+//flattens) has to be flat already
+class CharmString {
+private:
+	struct Node {
+		//leaves (no children) are length bytes starting at data: either their own text,
+		//or a slice of another leaf's, which they keep alive through source
+		std::string text;
+		std::shared_ptr<const Node> source;
+		const char* data = nullptr;
+		std::shared_ptr<const Node> left;
+		std::shared_ptr<const Node> right;
+		size_t length = 0;
+		unsigned int depth = 0;
+		//of the whole string, once something asks for it (0 until then)
+		mutable std::atomic<size_t> hash{0};
+		bool isLeaf() const { return !left; }
+		//(a leaf's text is charged to the thread that made it, see leaf())
+		~Node();
+	};
+	typedef std::shared_ptr<const Node> NodePtr;
+	//null if the string is empty
+	mutable NodePtr root;
+
+	explicit CharmString(NodePtr root) : root(root) {}
+	static NodePtr leaf(std::string&& text);
+	static NodePtr leafSlice(const NodePtr& leaf, size_t pos, size_t length);
+	static NodePtr branch(NodePtr left, NodePtr right);
+	static NodePtr join(NodePtr left, NodePtr right);
+	static NodePtr slice(const NodePtr& node, size_t pos, size_t length);
+	static NodePtr joinRight(const NodePtr& left, const NodePtr& right);
+	static NodePtr joinLeft(const NodePtr& left, const NodePtr& right);
+	static NodePtr rotateLeft(const NodePtr& node);
+	static NodePtr rotateRight(const NodePtr& node);
+	template <typename Chunk>
+	static bool forEachChunk(const Node* node, Chunk& chunk);
+public:
+	CharmString() {}
+	CharmString(const std::string& s);
+	CharmString(std::string&& s);
+	CharmString(const char* s);
+	//a one character string, without allocating anything
+	static CharmString character(char c);
+
+	size_t size() const { return root ? root->length : 0; }
+	bool empty() const { return !root; }
+	//doesn't flatten
+	char operator[](size_t n) const;
+	//the whole thing as one string, flattening it (once) if it has to
+	const std::string& str() const;
+	void flatten() const { str(); }
+
+	CharmString operator+(const CharmString& other) const;
+	void append(const CharmString& other);
+	void insert(size_t pos, const CharmString& other);
+	//shares the pieces with this one instead of copying them
+	CharmString substr(size_t pos, size_t length = std::string::npos) const;
+	//where pattern first shows up at or after from, or npos if it doesn't. doesn't flatten:
+	//each piece is searched with memmem, and matches that span pieces are looked for in a
+	//copy of the (pattern sized) bit either side of where they join
+	size_t find(const std::string& pattern, size_t from = 0) const;
+
+	//calls chunk(const char* data, size_t size) on each piece in order, without flattening.
+	//chunk returns false to stop early, and then so does this
+	template <typename Chunk>
+	bool forEachChunk(Chunk&& chunk) const {
+		return !root || forEachChunk(root.get(), chunk);
+	}
+
+	//remembered by the (flattened) string and its copies after the first time
+	size_t hash() const;
+
+	bool operator==(const CharmString& other) const;
+	bool operator!=(const CharmString& other) const { return !(*this == other); }
+};
+
+template <typename Chunk>
+bool CharmString::forEachChunk(const Node* node, Chunk& chunk) {
+	if (node->isLeaf()) {
+		return chunk(node->data, node->length);
+	}
+	//(ropes are kept balanced, so this doesn't go very deep)
+	return forEachChunk(node->left.get(), chunk) && forEachChunk(node->right.get(), chunk);
+}
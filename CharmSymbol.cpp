@@ -0,0 +1,26 @@
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+#include "CharmSymbol.h"
+
+const CharmSymbol::Entry* CharmSymbol::intern(const std::string& text) {
+	if (text.empty()) {
+		return nullptr;
+	}
+	//(function statics, so that symbols can be made while the program starts up)
+	static std::mutex mutex;
+	static std::unordered_map<std::string, std::size_t> table;
+	std::lock_guard<std::mutex> lock(mutex);
+	//the entries are never removed, and an unordered_map never moves them
+	auto entry = table.find(text);
+	if (entry == table.end()) {
+		entry = table.emplace(text, std::hash<std::string>()(text)).first;
+	}
+	return &*entry;
+}
+
+const std::string& CharmSymbol::str() const {
+	static const std::string emptyString;
+	return entry ? entry->first : emptyString;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <functional>
+#include <cstddef>
+
+//a function name: the text is interned in one table for the whole program (and never freed),
+//so a symbol is just a pointer to its entry. copying, comparing and hashing one is O(1),
+//and the text is still there for printing and error messages
+class CharmSymbol {
+private:
+	//the text, and its hash (worked out once, when it's interned)
+	typedef std::pair<const std::string, std::size_t> Entry;
+	//null for the empty name
+	const Entry* entry = nullptr;
+	static const Entry* intern(const std::string& text);
+public:
+	CharmSymbol() {}
+	CharmSymbol(const std::string& text) : entry(intern(text)) {}
+	CharmSymbol(const char* text) : entry(intern(text)) {}
+
+	const std::string& str() const;
+	operator const std::string&() const { return str(); }
+	const char* c_str() const { return str().c_str(); }
+	const char* data() const { return str().data(); }
+	std::size_t size() const { return str().size(); }
+	bool empty() const { return entry == nullptr; }
+	std::size_t hash() const { return entry ? entry->second : std::hash<std::string>()(std::string()); }
+
+	bool operator==(const CharmSymbol& other) const { return entry == other.entry; }
+	bool operator!=(const CharmSymbol& other) const { return entry != other.entry; }
+	//(against text that isn't interned, like a name being looked up)
+	bool operator==(const std::string& text) const { return str() == text; }
+	bool operator!=(const std::string& text) const { return str() != text; }
+	bool operator==(const char* text) const { return str() == text; }
+	bool operator!=(const char* text) const { return str() != text; }
+	bool operator<(const CharmSymbol& other) const { return str() < other.str(); }
+};
+
+inline bool operator==(const std::string& text, const CharmSymbol& symbol) { return symbol == text; }
+inline bool operator!=(const std::string& text, const CharmSymbol& symbol) { return symbol != text; }
+inline std::string operator+(const std::string& text, const CharmSymbol& symbol) { return text + symbol.str(); }
+inline std::string operator+(const CharmSymbol& symbol, const std::string& text) { return symbol.str() + text; }
+inline std::string operator+(const char* text, const CharmSymbol& symbol) { return text + symbol.str(); }
+inline std::string operator+(const CharmSymbol& symbol, const char* text) { return symbol.str() + text; }
+inline std::ostream& operator<<(std::ostream& out, const CharmSymbol& symbol) { return out << symbol.str(); }
+
+namespace std {
+	template <>
+	struct hash<CharmSymbol> {
+		size_t operator()(const CharmSymbol& symbol) const {
+			return symbol.hash();
+		}
+	};
+}
@@ -0,0 +1,66 @@
+#include <algorithm>
+
+#include "CompletionIndex.h"
+
+//orders children by their character, and finds one
+static bool childBefore(const std::pair<unsigned char, unsigned int>& child, unsigned char c) {
+	return child.first < c;
+}
+
+CompletionIndex::CompletionIndex() {
+	nodes.emplace_back();
+}
+
+long long CompletionIndex::find(const std::string& prefix) const {
+	unsigned int node = 0;
+	for (char character : prefix) {
+		unsigned char c = character;
+		const auto& children = nodes[node].children;
+		auto child = std::lower_bound(children.begin(), children.end(), c, childBefore);
+		if (child == children.end() || child->first != c) {
+			return -1;
+		}
+		node = child->second;
+	}
+	return node;
+}
+
+void CompletionIndex::insert(const std::string& name) {
+	unsigned int node = 0;
+	for (char character : name) {
+		unsigned char c = character;
+		auto& children = nodes[node].children;
+		auto child = std::lower_bound(children.begin(), children.end(), c, childBefore);
+		if (child != children.end() && child->first == c) {
+			node = child->second;
+			continue;
+		}
+		unsigned int added = nodes.size();
+		children.insert(child, std::make_pair(c, added));
+		//(after the insert, since this can move the nodes, children included)
+		nodes.emplace_back();
+		node = added;
+	}
+	nodes[node].isName = true;
+}
+
+void CompletionIndex::collect(unsigned int node, std::string& name, std::vector<std::string>& out) const {
+	//a name comes before the longer names it's the start of
+	if (nodes[node].isName) {
+		out.push_back(name);
+	}
+	for (const auto& child : nodes[node].children) {
+		name.push_back(child.first);
+		CompletionIndex::collect(child.second, name, out);
+		name.pop_back();
+	}
+}
+
+void CompletionIndex::complete(const std::string& prefix, std::vector<std::string>& out) const {
+	long long node = CompletionIndex::find(prefix);
+	if (node < 0) {
+		return;
+	}
+	std::string name = prefix;
+	CompletionIndex::collect(node, name, out);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+
+//the names that tab completion can finish: a prefix tree, so that finding the names that start
+//with something only looks at that prefix and the names under it, never at the rest.
+//names are only ever added (a definition can be replaced, but its name doesn't go away)
+class CompletionIndex {
+private:
+	struct Node {
+		//the next character of the names under this one and the node it leads to, in order
+		//of the characters (as unsigned chars, the way std::string compares them)
+		std::vector<std::pair<unsigned char, unsigned int>> children;
+		//whether a name ends here
+		bool isName = false;
+	};
+	//the nodes, by index. node 0 is the empty prefix
+	std::vector<Node> nodes;
+	//the node for the prefix, or -1 if nothing starts with it
+	long long find(const std::string& prefix) const;
+	void collect(unsigned int node, std::string& name, std::vector<std::string>& out) const;
+public:
+	CompletionIndex();
+	void insert(const std::string& name);
+	//the names that start with prefix, sorted, added to the end of out
+	void complete(const std::string& prefix, std::vector<std::string>& out) const;
+};
@@ -1,17 +1,68 @@
 #include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <deque>
 
 #include "FunctionAnalyzer.h"
 #include "ParserTypes.h"
+#include "Runner.h"
+#include "Superinstructions.h"
+#include "TypeInference.h"
+#include "Stack.h"
 #include "Error.h"
 #include "Debug.h"
 
+//room left under the known values for builtins that push more than they pop
+static const unsigned long long FOLDING_PADDING = 8;
+//the biggest function (see bodySize) that gets inlined into its callers...
+static const unsigned long long INLINE_CALLEE_BUDGET = 64;
+//...unless the profile says it's hot
+static const unsigned long long INLINE_HOT_MULTIPLIER = 4;
+//a function is hot if it's called at least 1/INLINE_HOT_FRACTION as much as the hottest one
+static const unsigned long long INLINE_HOT_FRACTION = 100;
+//how much inlining can grow a definition, on top of its own size
+static const unsigned long long INLINE_GROWTH_BUDGET = 256;
+
 FunctionAnalyzer::FunctionAnalyzer() {
+    memoizeAll = false;
+    hottestCallCount = 0;
+}
+
+FunctionAnalyzer::FoldingRunner::FoldingRunner() : runner(std::make_shared<Runner>()) {}
+FunctionAnalyzer::FoldingRunner::FoldingRunner(const FoldingRunner&) : runner(std::make_shared<Runner>()) {}
+FunctionAnalyzer::FoldingRunner& FunctionAnalyzer::FoldingRunner::operator=(const FoldingRunner&) {
+    //(keep our own)
+    return *this;
 }
 
 void FunctionAnalyzer::addTypeSignature(CharmTypeSignature t) {
     typeSignatures[t.functionName] = t;
 }
 
+void FunctionAnalyzer::addAnnotation(std::string fName, std::string annotation) {
+    if (annotation == "memoize") {
+        memoizeAnnotations.insert(fName);
+    } else {
+        runtime_die("Unrecognized annotation: " + annotation);
+    }
+}
+
+void FunctionAnalyzer::setMemoizeAll(bool m) {
+    memoizeAll = m;
+}
+
+void FunctionAnalyzer::addBuiltinFunction(std::string fName, std::function<void(Runner*)> f) {
+    predefinedFunctions.addBuiltinFunction(fName, f, false);
+}
+
+void FunctionAnalyzer::setCallCounts(std::unordered_map<std::string, unsigned long long> counts) {
+    callCounts = counts;
+    hottestCallCount = 0;
+    for (const auto& count : callCounts) {
+        hottestCallCount = std::max(hottestCallCount, count.second);
+    }
+}
+
 void FunctionAnalyzer::addToInlineDefinitions(CharmFunction f) {
     if (f.functionType == FUNCTION_DEFINITION) {
         ONLYDEBUG printf("Adding %s to the inlineDefinitions\n", f.functionName.c_str());
@@ -29,13 +80,17 @@ bool FunctionAnalyzer::doInline(CHARM_LIST_TYPE& out, CharmFunction currentFunct
         ONLYDEBUG printf("PERFORMING INLINE REPLACEMENT FOR %s\n    %s -> ", currentFunction.functionName.c_str(), currentFunction.functionName.c_str());
         for (CharmFunction inlineReplacement : fIter->second.literalFunctions) {
             out.push_back(inlineReplacement);
-            ONLYDEBUG printf("%s ", charmFunctionToString(inlineReplacement).c_str());
+            if (DEBUGMODE) {
+                printCharmFunction(stdout, inlineReplacement);
+                printf(" ");
+            }
         }
         ONLYDEBUG printf("\n");
         if (DEBUGMODE) {
             printf("AFTER INLINE OPTIMIZATION, OUT NOW LOOKS LIKE THIS:\n     ");
-            for (CharmFunction f : out) {
-                printf("%s ", charmFunctionToString(f).c_str());
+            for (const CharmFunction& f : out) {
+                printCharmFunction(stdout, f);
+                printf(" ");
             }
             printf("\n");
         }
@@ -44,23 +99,228 @@ bool FunctionAnalyzer::doInline(CHARM_LIST_TYPE& out, CharmFunction currentFunct
     return false;
 }
 
-bool FunctionAnalyzer::_isInlineable(std::string fName, CharmFunction f) {
-	//if the function calls itself, it's recursive and not inlineable
-	bool recursive = false;
-	for (unsigned long long fIndex = 0; fIndex < f.literalFunctions.size(); fIndex++) {
-		if (f.literalFunctions[fIndex].functionType == LIST_FUNCTION) {
-			recursive = recursive || (!_isInlineable(fName, f.literalFunctions[fIndex]));
-		} else {
-			recursive = recursive || (fName == f.literalFunctions[fIndex].functionName);
-		}
-		if (recursive) {
-			break;
-		}
-	}
-	return !recursive;
+unsigned long long FunctionAnalyzer::bodySize(const CHARM_LIST_TYPE& body) {
+    unsigned long long size = body.size();
+    for (const CharmFunction& f : body) {
+        if (f.functionType == LIST_FUNCTION) {
+            size += bodySize(f.literalFunctions);
+        }
+    }
+    return size;
+}
+
+void FunctionAnalyzer::collectCalls(const CHARM_LIST_TYPE& body, std::set<std::string>& calls) {
+    for (const CharmFunction& f : body) {
+        if (f.functionType == LIST_FUNCTION) {
+            //lists might get run, so a call in any list counts
+            collectCalls(f.literalFunctions, calls);
+        } else if (f.functionType == DEFINED_FUNCTION && !predefinedFunctions.isBuiltinFunction(f.functionName)) {
+            calls.insert(f.functionName);
+        }
+    }
+}
+
+std::set<std::string> FunctionAnalyzer::reachableFrom(std::string fName) {
+    //everything fName can end up calling (not counting itself, unless it's recursive)
+    std::set<std::string> reached;
+    std::vector<std::string> toVisit = { fName };
+    while (toVisit.size() > 0) {
+        std::string current = toVisit.back();
+        toVisit.pop_back();
+        auto sourceIter = sourceDefinitions.find(current);
+        if (sourceIter == sourceDefinitions.end()) {
+            continue;
+        }
+        std::set<std::string> calls;
+        collectCalls(sourceIter->second.literalFunctions, calls);
+        for (const std::string& call : calls) {
+            if (reached.insert(call).second) {
+                toVisit.push_back(call);
+            }
+        }
+    }
+    return reached;
+}
+
+bool FunctionAnalyzer::isRecursive(std::string fName) {
+    std::set<std::string> reached = reachableFrom(fName);
+    return (reached.find(fName) != reached.end());
+}
+
+std::set<std::string> FunctionAnalyzer::recursiveCycle(std::string fName) {
+    //the functions fName reaches that reach fName back
+    std::set<std::string> cycle;
+    for (const std::string& reached : reachableFrom(fName)) {
+        if (reachableFrom(reached).count(fName) > 0) {
+            cycle.insert(reached);
+        }
+    }
+    return cycle;
+}
+
+bool FunctionAnalyzer::isHot(std::string fName) {
+    auto countIter = callCounts.find(fName);
+    if (countIter == callCounts.end()) {
+        return false;
+    }
+    return (countIter->second * INLINE_HOT_FRACTION >= hottestCallCount);
+}
+
+//collect the calls in body and in its code quotations (the lists that only ever get run)
+static void findCallSites(const CHARM_LIST_TYPE& body, std::vector<const CharmFunction*>& sites) {
+    std::vector<bool> quotations = FunctionAnalyzer::findCodeQuotations(body);
+    for (unsigned long long n = 0; n < body.size(); n++) {
+        if (body[n].functionType == DEFINED_FUNCTION) {
+            sites.push_back(&body[n]);
+        } else if (quotations[n]) {
+            findCallSites(body[n].literalFunctions, sites);
+        }
+    }
+}
+
+static CHARM_LIST_TYPE spliceCallSites(const CHARM_LIST_TYPE& body, const std::unordered_map<const CharmFunction*, const CHARM_LIST_TYPE*>& replacements) {
+    CHARM_LIST_TYPE out;
+    for (const CharmFunction& f : body) {
+        auto replacementIter = replacements.find(&f);
+        if (replacementIter != replacements.end()) {
+            out.insert(out.end(), replacementIter->second->begin(), replacementIter->second->end());
+        } else if (f.functionType == LIST_FUNCTION) {
+            CharmFunction list = f;
+            list.literalFunctions = spliceCallSites(f.literalFunctions, replacements);
+            out.push_back(list);
+        } else {
+            out.push_back(f);
+        }
+    }
+    return out;
+}
+
+void FunctionAnalyzer::inlineCalls(std::string fName, CHARM_LIST_TYPE& body, DefinitionStatistics& stats) {
+    std::vector<const CharmFunction*> sites;
+    findCallSites(body, sites);
+    //with a profile, the hottest calls get the growth budget first
+    //(stable, so otherwise it's first come first served)
+    std::stable_sort(sites.begin(), sites.end(), [this](const CharmFunction* a, const CharmFunction* b) {
+        auto aIter = callCounts.find(a->functionName);
+        auto bIter = callCounts.find(b->functionName);
+        unsigned long long aCount = (aIter == callCounts.end()) ? 0 : aIter->second;
+        unsigned long long bCount = (bIter == callCounts.end()) ? 0 : bIter->second;
+        return aCount > bCount;
+    });
+    unsigned long long size = bodySize(body);
+    unsigned long long maxSize = size + std::max(size, INLINE_GROWTH_BUDGET);
+    std::unordered_map<const CharmFunction*, const CHARM_LIST_TYPE*> replacements;
+    for (const CharmFunction* site : sites) {
+        if (site->functionName == fName) {
+            continue;
+        }
+        auto definitionIter = inlineDefinitions.find(site->functionName);
+        if (definitionIter == inlineDefinitions.end()) {
+            continue;
+        }
+        //callees were built before their callers, so this is already inlined as far as it goes
+        const CHARM_LIST_TYPE& calleeBody = definitionIter->second.literalFunctions;
+        unsigned long long calleeSize = bodySize(calleeBody);
+        unsigned long long budget = INLINE_CALLEE_BUDGET * (isHot(site->functionName) ? INLINE_HOT_MULTIPLIER : 1);
+        if (calleeSize > budget || size - 1 + calleeSize > maxSize) {
+            continue;
+        }
+        size = size - 1 + calleeSize;
+        replacements[site] = &calleeBody;
+    }
+    stats.inlinedCalls = replacements.size();
+    if (replacements.size() > 0) {
+        body = spliceCallSites(body, replacements);
+    }
+}
+
+static bool sameDefinition(const CharmFunction& a, const CharmFunction& b) {
+    if (a.definitionInfo.inlineable != b.definitionInfo.inlineable) return false;
+    if (a.definitionInfo.checkedPopsCount != b.definitionInfo.checkedPopsCount) return false;
+    if (!std::equal(a.definitionInfo.checkedPops, a.definitionInfo.checkedPops + a.definitionInfo.checkedPopsCount, b.definitionInfo.checkedPops)) return false;
+    if (a.definitionInfo.tailCallRecursive != b.definitionInfo.tailCallRecursive) return false;
+    if (a.definitionInfo.memoized != b.definitionInfo.memoized) return false;
+    if (a.literalFunctions.size() != b.literalFunctions.size()) return false;
+    for (unsigned long long n = 0; n < a.literalFunctions.size(); n++) {
+        if (!(a.literalFunctions[n] == b.literalFunctions[n])) return false;
+    }
+    return true;
 }
-bool FunctionAnalyzer::isInlinable(CharmFunction f) {
-	return (_isInlineable(f.functionName, f));
+
+CharmFunction FunctionAnalyzer::buildDefinition(std::string fName) {
+    CharmFunction f = sourceDefinitions.at(fName);
+    DefinitionStatistics& stats = definitionStatistics[fName];
+    stats.sourceSize = f.literalFunctions.size();
+    stats.inlinedCalls = 0;
+    if (OPTIMIZE_INLINE) {
+        inlineCalls(fName, f.literalFunctions, stats);
+    }
+    //evaluate what we can ahead of time
+    optimizeDefinition(f);
+    analyzeTypes(f);
+    //memoized functions have to stay as calls so that they can hit the cache
+    analyzeMemoization(f, f.definitionInfo);
+    f.definitionInfo.inlineable = !f.definitionInfo.memoized && !isRecursive(fName);
+    f.definitionInfo.tailCallRecursive = isTailCallRecursive(f);
+    return f;
+}
+
+void FunctionAnalyzer::storeDefinition(CharmFunction f) {
+    definitions[f.functionName] = f;
+    //inlineDefinitions is used for parsing future DEFINED_FUNCTIONs outside of definitions
+    //(and by inlineCalls). specialized arithmetic might not be proven wherever it ends up
+    if (f.definitionInfo.inlineable) {
+        TypeInference::despecialize(f.literalFunctions);
+        addToInlineDefinitions(f);
+    } else {
+        inlineDefinitions.erase(f.functionName);
+    }
+}
+
+CharmFunction FunctionAnalyzer::addDefinition(CharmFunction f) {
+    std::string fName = f.functionName;
+    //update the call graph, taking out the old edges if this is a redefinition
+    auto oldIter = sourceDefinitions.find(fName);
+    if (oldIter != sourceDefinitions.end()) {
+        std::set<std::string> oldCalls;
+        collectCalls(oldIter->second.literalFunctions, oldCalls);
+        for (const std::string& call : oldCalls) {
+            callers[call].erase(fName);
+        }
+    }
+    sourceDefinitions[fName] = f;
+    std::set<std::string> calls;
+    collectCalls(f.literalFunctions, calls);
+    for (const std::string& call : calls) {
+        callers[call].insert(fName);
+    }
+    CharmFunction out = buildDefinition(fName);
+    storeDefinition(out);
+    //everything that calls this was built without it (or with an old version of it),
+    //so rebuild them, and then whatever calls those if they changed, and so on
+    std::deque<std::string> stale(callers[fName].begin(), callers[fName].end());
+    while (stale.size() > 0) {
+        std::string staleName = stale.front();
+        stale.pop_front();
+        CharmFunction rebuilt = buildDefinition(staleName);
+        if (sameDefinition(rebuilt, definitions.at(staleName))) {
+            continue;
+        }
+        ONLYDEBUG printf("REBUILT %s AFTER %s WAS DEFINED\n", staleName.c_str(), fName.c_str());
+        storeDefinition(rebuilt);
+        updatedDefinitions.erase(std::remove_if(updatedDefinitions.begin(), updatedDefinitions.end(), [&staleName](const CharmFunction& u) {
+            return u.functionName == staleName;
+        }), updatedDefinitions.end());
+        updatedDefinitions.push_back(rebuilt);
+        stale.insert(stale.end(), callers[staleName].begin(), callers[staleName].end());
+    }
+    return out;
+}
+
+std::vector<CharmFunction> FunctionAnalyzer::takeUpdatedDefinitions() {
+    std::vector<CharmFunction> out;
+    out.swap(updatedDefinitions);
+    return out;
 }
 
 bool FunctionAnalyzer::isTailCallRecursive(CharmFunction f) {
@@ -75,3 +335,406 @@ bool FunctionAnalyzer::isTailCallRecursive(CharmFunction f) {
         return false;
     }
 }
+
+bool FunctionAnalyzer::_isPure(CharmFunction f, std::unordered_set<std::string>& visited) {
+    for (const CharmFunction& fs : f.literalFunctions) {
+        if (fs.functionType == LIST_FUNCTION) {
+            //lists may be run with ifthen, so they have to be pure too
+            if (!_isPure(fs, visited)) return false;
+        } else if (fs.functionType == FUNCTION_DEFINITION) {
+            return false;
+        } else if (fs.functionType == DEFINED_FUNCTION) {
+            if (predefinedFunctions.isBuiltinFunction(fs.functionName)) {
+                if (!predefinedFunctions.isPureBuiltinFunction(fs.functionName)) return false;
+            } else if (visited.find(fs.functionName) == visited.end()) {
+                //functions we haven't seen the definition of (yet) could do anything
+                auto fIter = definitions.find(fs.functionName);
+                if (fIter == definitions.end()) return false;
+                visited.insert(fs.functionName);
+                if (!_isPure(fIter->second, visited)) return false;
+            }
+        }
+    }
+    return true;
+}
+bool FunctionAnalyzer::isPure(CharmFunction f) {
+    std::unordered_set<std::string> visited = { f.functionName };
+    return _isPure(f, visited);
+}
+
+void FunctionAnalyzer::analyzeMemoization(CharmFunction f, CharmFunctionDefinitionInfo& info) {
+    info.memoized = false;
+    info.memoizedPops = 0;
+    info.memoizedPushes = 0;
+    bool annotated = (memoizeAnnotations.find(f.functionName) != memoizeAnnotations.end());
+    //written down or inferred, the signature says which values are the arguments
+    CharmTypeSignature signature;
+    bool proven;
+    bool hasSignature = signatureOf(f.functionName, signature, proven);
+    //a written signature that inference couldn't check might take fewer values than the function
+    //really uses, and then the cache would give back results for the wrong arguments
+    bool verified = hasSignature && (typeSignatures.find(f.functionName) == typeSignatures.end() ||
+        verifiedSignatures.find(f.functionName) != verifiedSignatures.end());
+    if (annotated) {
+        //the user asked for this one, so tell them if we can't do it
+        if (!hasSignature) {
+            runtime_die("Can't memoize `" + f.functionName + "` without a type signature (and one couldn't be inferred).");
+        }
+        if (!verified) {
+            runtime_die("Can't verify signature for memoized function `" + f.functionName + "`: what it does to the stack couldn't be worked out.");
+        }
+        if (!isPure(f)) {
+            runtime_die("Can't memoize `" + f.functionName + "` because it isn't pure.");
+        }
+        if (isTailCallRecursive(f)) {
+            runtime_die("Can't memoize `" + f.functionName + "` because it never returns.");
+        }
+    } else if (memoizeAll) {
+        //non recursive functions get inlined instead, and tail call recursive
+        //functions are loops - neither gain anything from memoization
+        if (!verified || !isRecursive(f.functionName) || isTailCallRecursive(f) || !isPure(f)) {
+            return;
+        }
+    } else {
+        return;
+    }
+    info.memoized = true;
+    info.memoizedPops = signature.pops.size();
+    info.memoizedPushes = signature.pushes.size();
+}
+
+bool FunctionAnalyzer::signatureOf(std::string fName, CharmTypeSignature& signature, bool& proven) {
+    auto sigIter = typeSignatures.find(fName);
+    if (sigIter != typeSignatures.end()) {
+        signature = sigIter->second;
+        proven = (provenSignatures.find(fName) != provenSignatures.end());
+        return true;
+    }
+    auto inferredIter = inferredSignatures.find(fName);
+    if (inferredIter != inferredSignatures.end()) {
+        signature = inferredIter->second;
+        proven = false;
+        return true;
+    }
+    return false;
+}
+
+TypeInference FunctionAnalyzer::typeInference(std::string fName) {
+    return TypeInference(fName, [this](const std::string& name, CharmTypeSignature& signature, bool& proven) {
+        return signatureOf(name, signature, proven);
+    });
+}
+
+static std::string typesToString(const std::vector<CharmTypes>& types) {
+    std::string out;
+    for (CharmTypes t : types) {
+        out += " " + TypeInference::typeName(t);
+    }
+    return out;
+}
+
+bool FunctionAnalyzer::checkTypeSignature(CharmFunction f, CHARM_LIST_TYPE& definition) {
+    const CharmTypeSignature& signature = typeSignatures.at(f.functionName);
+    DefinitionStatistics& stats = definitionStatistics[f.functionName];
+    TypeInference inference = typeInference(f.functionName);
+    //first, go with the inputs being what the signature says
+    InferenceResult seeded = inference.infer(definition, &signature, true);
+    std::string error = seeded.mismatch;
+    bool proven = seeded.known && !seeded.unprovenSelfCalls;
+    if (error == "" && seeded.known) {
+        if (seeded.effect.pops.size() > signature.pops.size()) {
+            error = "it takes" + typesToString(seeded.effect.pops) + " off the stack.";
+        } else if (seeded.effect.pushes.size() != signature.pushes.size()) {
+            error = "it leaves" + typesToString(seeded.effect.pushes) + " on the stack.";
+        } else {
+            for (unsigned long long n = 0; n < signature.pushes.size(); n++) {
+                CharmTypes narrowed;
+                if (!TypeInference::meet(seeded.effect.pushes[n], signature.pushes[n], narrowed)) {
+                    error = "it leaves" + typesToString(seeded.effect.pushes) + " on the stack.";
+                    break;
+                }
+                //everything it leaves has to definitely be what the signature says
+                proven = proven && seeded.provenPushes[n] && (narrowed == seeded.effect.pushes[n]);
+            }
+        }
+    }
+    if (error != "") {
+        runtime_die("The type signature of `" + f.functionName + "` doesn't match its definition: " + error);
+    }
+    if (seeded.known) {
+        verifiedSignatures.insert(f.functionName);
+    }
+    //(and there's only room to check so many arguments)
+    proven = proven && (signature.pops.size() <= MAX_CHECKED_POPS);
+    if (proven) {
+        stats.specializedCalls = TypeInference::specialize(seeded);
+        return true;
+    }
+    if (seeded.known) {
+        //the signature checks out, but the definition doesn't prove it. so only
+        //what the definition makes itself (like literals) can be relied on
+        InferenceResult unseeded = inference.infer(definition, &signature, false);
+        stats.specializedCalls = TypeInference::specialize(unseeded);
+    }
+    return false;
+}
+
+void FunctionAnalyzer::inferTypeSignature(CharmFunction& f) {
+    DefinitionStatistics& stats = definitionStatistics[f.functionName];
+    TypeInference inference = typeInference(f.functionName);
+    InferenceResult first = inference.infer(f.literalFunctions, nullptr, false);
+    if (!first.unresolvedSelfCalls) {
+        //(if it couldn't be followed all the way, what came before that is still proven)
+        stats.specializedCalls = TypeInference::specialize(first);
+        if (first.known) {
+            inferredSignatures[f.functionName] = first.effect;
+        }
+        return;
+    }
+    if (!first.known) {
+        return;
+    }
+    //a recursive function: the base case gives a guess at the signature,
+    //which is right if the whole definition agrees with it
+    InferenceResult second = inference.infer(f.literalFunctions, &first.effect, false);
+    if (second.known && TypeInference::sameSignature(second.effect, first.effect)) {
+        inferredSignatures[f.functionName] = second.effect;
+        stats.specializedCalls = TypeInference::specialize(second);
+    }
+}
+
+void FunctionAnalyzer::analyzeTypes(CharmFunction& f) {
+    inferredSignatures.erase(f.functionName);
+    provenSignatures.erase(f.functionName);
+    verifiedSignatures.erase(f.functionName);
+    f.definitionInfo.checkedPopsCount = 0;
+    definitionStatistics[f.functionName].specializedCalls = 0;
+    if (typeSignatures.find(f.functionName) != typeSignatures.end()) {
+        if (checkTypeSignature(f, f.literalFunctions)) {
+            provenSignatures.insert(f.functionName);
+            const std::vector<CharmTypes>& pops = typeSignatures.at(f.functionName).pops;
+            f.definitionInfo.checkedPopsCount = pops.size();
+            std::copy(pops.begin(), pops.end(), f.definitionInfo.checkedPops);
+        }
+    } else {
+        inferTypeSignature(f);
+    }
+}
+
+static bool isFoldingSentinel(const CharmFunction& f) {
+    //the parser never makes a function with an empty name
+    return (f.functionType == DEFINED_FUNCTION) && (f.functionName == "");
+}
+
+//folded values end up in definitions, which runners on different threads read at the same
+//time, so the strings in them have to be flat already (see CharmString)
+static void flattenStrings(CharmFunction& f) {
+    f.stringValue.flatten();
+    for (CharmFunction& fs : f.literalFunctions) {
+        flattenStrings(fs);
+    }
+}
+
+//maps are shared between copies and changed in place when nothing else has them, so
+//one can't be a literal that every run of a definition would share
+static bool containsMap(const CharmFunction& f) {
+    if (f.functionType == MAP_FUNCTION) {
+        return true;
+    }
+    for (const CharmFunction& fs : f.literalFunctions) {
+        if (containsMap(fs)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FunctionAnalyzer::foldBuiltin(std::string fName, CHARM_LIST_TYPE& known) {
+    //builtins without a fixed stack effect (or that aren't pure) are never folded
+    auto sigIter = TypeInference::builtinSignatures().find(fName);
+    if (sigIter == TypeInference::builtinSignatures().end() || !predefinedFunctions.isPureBuiltinFunction(fName)) {
+        return false;
+    }
+    if (known.size() < sigIter->second.pops.size()) {
+        return false;
+    }
+    const CharmFunction& top = known.back();
+    if (fName == "swap") {
+        //swap reaches under its arguments, so the swapped values have to be known too
+        const CharmFunction& under = known[known.size() - 2];
+        if (!Stack::isInt(top) || !Stack::isInt(under)) return false;
+        if (top.numberValue.integerValue < 0 || under.numberValue.integerValue < 0) return false;
+        unsigned long long deepest = (unsigned long long)std::max(top.numberValue.integerValue, under.numberValue.integerValue);
+        if (deepest + 1 > known.size() - 2) return false;
+    }
+    //run the builtin for real on the folding runner, on top of a sentinel
+    //so that we can tell afterwards which values it left behind
+    CharmFunction sentinel;
+    sentinel.functionType = DEFINED_FUNCTION;
+    sentinel.functionName = "";
+    Stack* scratch = foldingRunner.runner->getCurrentStack();
+    scratch->stack.assign(FOLDING_PADDING, Stack::zeroF());
+    scratch->stack.push_back(sentinel);
+    scratch->stack.insert(scratch->stack.end(), known.begin(), known.end());
+    try {
+        foldingRunner.runner->pF->functionLookup(fName, foldingRunner.runner.get(), nullptr);
+    } catch (const std::runtime_error& e) {
+        //the error will happen when the code is run instead
+        ONLYDEBUG printf("NOT FOLDING %s: %s\n", fName.c_str(), e.what());
+        return false;
+    }
+    auto sentinelIter = std::find_if(scratch->stack.rbegin(), scratch->stack.rend(), isFoldingSentinel);
+    if (sentinelIter == scratch->stack.rend()) {
+        return false;
+    }
+    if (std::any_of(sentinelIter.base(), scratch->stack.end(), containsMap)) {
+        return false;
+    }
+    known.assign(sentinelIter.base(), scratch->stack.end());
+    for (CharmFunction& f : known) {
+        flattenStrings(f);
+    }
+    return true;
+}
+
+std::vector<bool> FunctionAnalyzer::findCodeQuotations(const CHARM_LIST_TYPE& body) {
+    //lists directly before an `i` or the three before an `ifthen` are only ever
+    //run, never looked at, so the optimization passes can rewrite them too
+    std::vector<bool> isCode(body.size(), false);
+    for (unsigned long long n = 0; n < body.size(); n++) {
+        if (body[n].functionType != DEFINED_FUNCTION) continue;
+        unsigned long long quotations = 0;
+        if (body[n].functionName == "i") quotations = 1;
+        if (body[n].functionName == "ifthen") quotations = 3;
+        if (n < quotations) continue;
+        bool allLists = true;
+        for (unsigned long long q = n - quotations; q < n; q++) {
+            allLists = allLists && (body[q].functionType == LIST_FUNCTION);
+        }
+        if (allLists) {
+            for (unsigned long long q = n - quotations; q < n; q++) isCode[q] = true;
+        }
+    }
+    return isCode;
+}
+
+void FunctionAnalyzer::_foldConstants(CHARM_LIST_TYPE& body, DefinitionStatistics& stats) {
+    std::vector<bool> isCode = findCodeQuotations(body);
+
+    CHARM_LIST_TYPE out;
+    //the values we know are on top of the (unknown) stack
+    CHARM_LIST_TYPE known;
+    auto flushKnown = [&]() {
+        out.insert(out.end(), known.begin(), known.end());
+        known.clear();
+    };
+    for (unsigned long long n = 0; n < body.size(); n++) {
+        CharmFunction f = body[n];
+        if (f.functionType == LIST_FUNCTION) {
+            if (isCode[n]) {
+                _foldConstants(f.literalFunctions, stats);
+            }
+            known.push_back(f);
+        } else if (f.functionType == NUMBER_FUNCTION || f.functionType == STRING_FUNCTION) {
+            known.push_back(f);
+        } else if (f.functionType == DEFINED_FUNCTION && foldBuiltin(f.functionName, known)) {
+            ONLYDEBUG printf("FOLDED A CALL TO %s\n", f.functionName.c_str());
+            stats.foldedCalls++;
+        } else {
+            flushKnown();
+            out.push_back(f);
+        }
+    }
+    flushKnown();
+    body = out;
+}
+
+void FunctionAnalyzer::optimizeDefinition(CharmFunction& f) {
+    DefinitionStatistics& stats = definitionStatistics[f.functionName];
+    //superinstructions that came in through inlining get expanded, so that folding can see through them
+    if (OPTIMIZE_SUPERINSTRUCTIONS) {
+        Superinstructions::expand(f.literalFunctions);
+    }
+    stats.parsedSize = f.literalFunctions.size();
+    stats.foldedCalls = 0;
+    if (OPTIMIZE_CONSTANTS) {
+        _foldConstants(f.literalFunctions, stats);
+    }
+    stats.foldedSize = f.literalFunctions.size();
+    stats.superinstructions = 0;
+    if (OPTIMIZE_SUPERINSTRUCTIONS) {
+        stats.superinstructions = Superinstructions::fuse(f.literalFunctions);
+    }
+    stats.fusedSize = f.literalFunctions.size();
+    if (DEBUGMODE) {
+        printf("AFTER OPTIMIZATION, %s LOOKS LIKE THIS:\n     ", f.functionName.c_str());
+        for (const CharmFunction& fs : f.literalFunctions) {
+            printCharmFunction(stdout, fs);
+            printf(" ");
+        }
+        printf("\n");
+    }
+}
+
+std::string FunctionAnalyzer::analysisReport(std::string fName) {
+    std::stringstream out;
+    auto fIter = definitions.find(fName);
+    if (fIter == definitions.end()) {
+        out << "`" << fName << "` isn't defined in Charm (it might be a builtin)." << std::endl;
+        return out.str();
+    }
+    const CharmFunction& f = fIter->second;
+    const CharmFunctionDefinitionInfo& info = f.definitionInfo;
+    out << "Analysis of `" << fName << "`:" << std::endl;
+    CharmTypeSignature signature;
+    bool proven;
+    if (signatureOf(fName, signature, proven)) {
+        bool inferred = (typeSignatures.find(fName) == typeSignatures.end());
+        out << "    type signature:" << typesToString(signature.pops) << " ->" << typesToString(signature.pushes);
+        out << (inferred ? " (inferred)" : (proven ? " (proven)" : "")) << std::endl;
+    }
+    out << "    inlineable: " << (info.inlineable ? "yes" : "no") << std::endl;
+    if (isRecursive(fName)) {
+        out << "    recursive, through:";
+        for (const std::string& cycleName : recursiveCycle(fName)) out << " " << cycleName;
+        out << std::endl;
+    }
+    out << "    tail call recursive: " << (info.tailCallRecursive ? "yes" : "no") << std::endl;
+    out << "    pure: " << (isPure(f) ? "yes" : "no") << std::endl;
+    out << "    memoized: " << (info.memoized ? "yes" : "no") << std::endl;
+    auto statsIter = definitionStatistics.find(fName);
+    if (statsIter != definitionStatistics.end()) {
+        const DefinitionStatistics& stats = statsIter->second;
+        out << "    inlining: " << stats.sourceSize << " -> " << stats.parsedSize << " functions, ";
+        out << stats.inlinedCalls << " calls inlined" << std::endl;
+        out << "    constant folding: " << stats.parsedSize << " -> " << stats.foldedSize << " functions, ";
+        out << stats.foldedCalls << " builtin calls evaluated ahead of time" << std::endl;
+        out << "    superinstructions: " << stats.foldedSize << " -> " << stats.fusedSize << " functions, ";
+        out << stats.superinstructions << " sequences fused" << std::endl;
+        out << "    unchecked arithmetic: " << stats.specializedCalls << std::endl;
+    }
+    out << "    body: ";
+    for (const CharmFunction& fs : f.literalFunctions) {
+        out << charmFunctionToString(fs) << " ";
+    }
+    out << std::endl;
+    //and the totals, to see how much the passes do overall
+    unsigned long long sourceTotal = 0, inlinedTotal = 0, parsedTotal = 0, foldedTotal = 0, callsTotal = 0, fusedTotal = 0, superinstructionsTotal = 0, specializedTotal = 0;
+    for (const auto& stats : definitionStatistics) {
+        sourceTotal += stats.second.sourceSize;
+        inlinedTotal += stats.second.inlinedCalls;
+        parsedTotal += stats.second.parsedSize;
+        foldedTotal += stats.second.foldedSize;
+        callsTotal += stats.second.foldedCalls;
+        fusedTotal += stats.second.fusedSize;
+        superinstructionsTotal += stats.second.superinstructions;
+        specializedTotal += stats.second.specializedCalls;
+    }
+    out << "Over all " << definitionStatistics.size() << " definitions, inlining took " << sourceTotal
+        << " functions as written up to " << parsedTotal << " (" << inlinedTotal << " calls inlined)," << std::endl;
+    out << "constant folding took "
+        << parsedTotal << " functions down to " << foldedTotal << " (" << callsTotal << " builtin calls evaluated)," << std::endl;
+    out << "and superinstructions took that down to " << fusedTotal << " (" << superinstructionsTotal << " sequences fused)." << std::endl;
+    out << specializedTotal << " arithmetic calls were proven to only see ints, and skip checking them." << std::endl;
+    return out.str();
+}
@@ -1,24 +1,138 @@
 #pragma once
 
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <memory>
+#include <set>
+#include <vector>
+#include <functional>
 
 #include "ParserTypes.h"
+#include "PredefinedFunctions.h"
+#include "TypeInference.h"
+
+//In Runner.h
+class Runner;
+
+//what the optimization passes did to a definition, reported by `charm -a`
+struct DefinitionStatistics {
+    //body size as written
+    unsigned long long sourceSize;
+    //calls that were replaced by the body of the function they call
+    unsigned long long inlinedCalls;
+    //body size as parsed (after inlining)
+    unsigned long long parsedSize;
+    //body size after constant folding
+    unsigned long long foldedSize;
+    //builtin calls that were evaluated at parse time
+    unsigned long long foldedCalls;
+    //body size after fusing superinstructions
+    unsigned long long fusedSize;
+    unsigned long long superinstructions;
+    //arithmetic replaced by its unchecked version
+    unsigned long long specializedCalls;
+};
 
 class FunctionAnalyzer {
 private:
-    bool _isInlineable(std::string fName, CharmFunction f);
-    std::unordered_map<std::string, CharmFunction> inlineDefinitions;
+    bool _isPure(CharmFunction f, std::unordered_set<std::string>& visited);
+    std::unordered_map<CharmSymbol, CharmFunction> inlineDefinitions;
     std::unordered_map<std::string, CharmTypeSignature> typeSignatures;
+    //signatures for the definitions that don't have one written down
+    std::unordered_map<std::string, CharmTypeSignature> inferredSignatures;
+    //written down signatures that checkTypeSignature proved
+    std::unordered_set<std::string> provenSignatures;
+    //and the ones whose stack effect it could work out and check (proven or not). only these,
+    //and inferred signatures, are trusted to say how many arguments a memoized function takes
+    std::unordered_set<std::string> verifiedSignatures;
+    //every definition that has been parsed, inlineable or not, as written...
+    std::unordered_map<std::string, CharmFunction> sourceDefinitions;
+    //...and after inlining and the other optimizations
+    std::unordered_map<std::string, CharmFunction> definitions;
+    //the call graph, backwards: who calls each function
+    std::unordered_map<std::string, std::set<std::string>> callers;
+    //definitions that were rebuilt because something they call changed, waiting for the parser to emit them
+    std::vector<CharmFunction> updatedDefinitions;
+    //how often each function was called in a profiled run (see Profiler.h)
+    std::unordered_map<std::string, unsigned long long> callCounts;
+    unsigned long long hottestCallCount;
+    //functions annotated with `f :@ memoize`
+    std::unordered_set<std::string> memoizeAnnotations;
+    bool memoizeAll;
+    //used to look up which builtins are pure
+    PredefinedFunctions predefinedFunctions;
+    //the builtins are run on this runner's stack to fold constants. copies of
+    //an analyzer get their own, so that they can be used on different threads
+    struct FoldingRunner {
+        std::shared_ptr<Runner> runner;
+        FoldingRunner();
+        FoldingRunner(const FoldingRunner&);
+        FoldingRunner& operator=(const FoldingRunner&);
+    };
+    FoldingRunner foldingRunner;
+    std::unordered_map<std::string, DefinitionStatistics> definitionStatistics;
+    bool foldBuiltin(std::string fName, CHARM_LIST_TYPE& known);
+    void _foldConstants(CHARM_LIST_TYPE& body, DefinitionStatistics& stats);
+    //the defined functions a body calls, including the ones in its lists
+    void collectCalls(const CHARM_LIST_TYPE& body, std::set<std::string>& calls);
+    std::set<std::string> reachableFrom(std::string fName);
+    bool isHot(std::string fName);
+    //replace the calls in body (and in its code quotations) with the bodies
+    //of what they call, as far as the size budgets allow
+    void inlineCalls(std::string fName, CHARM_LIST_TYPE& body, DefinitionStatistics& stats);
+    //inline, optimize, and analyze a definition from its source
+    CharmFunction buildDefinition(std::string fName);
+    void storeDefinition(CharmFunction f);
+    TypeInference typeInference(std::string fName);
+    //check the signature of a definition if it has one, infer one if it doesn't
+    void analyzeTypes(CharmFunction& f);
+    void inferTypeSignature(CharmFunction& f);
 public:
     FunctionAnalyzer();
 
-    bool isInlinable(CharmFunction f);
+    //whether a function can end up calling itself, directly or through other functions
+    bool isRecursive(std::string fName);
+    //every function in the same recursive cycle as fName
+    std::set<std::string> recursiveCycle(std::string fName);
     bool isTailCallRecursive(CharmFunction f);
+    bool isPure(CharmFunction f);
+    //the size of a body in functions, counting everything inside of its lists
+    static unsigned long long bodySize(const CHARM_LIST_TYPE& body);
 
     void addToInlineDefinitions(CharmFunction f);
+    //takes a freshly parsed definition and returns it inlined, optimized, and analyzed.
+    //functions defined earlier that call it get rebuilt too, see takeUpdatedDefinitions()
+    CharmFunction addDefinition(CharmFunction f);
+    //the earlier definitions that changed since the last call, to be run again after the new one
+    std::vector<CharmFunction> takeUpdatedDefinitions();
     bool doInline(CHARM_LIST_TYPE& out, CharmFunction currentFunction);
+    //call counts from a profile, hot functions get a bigger inlining budget
+    void setCallCounts(std::unordered_map<std::string, unsigned long long> counts);
 
     void addTypeSignature(CharmTypeSignature t);
-    bool checkTypeSignature(CharmFunction f, CHARM_LIST_TYPE definition);
+    //checks a definition against the type signature written for it, dying if they definitely
+    //don't match. returns whether the signature is proven: if it is, calls to the function get
+    //their arguments checked against it, and the arithmetic in the definition that depends on
+    //that is specialized. either way, arithmetic on values the definition makes is specialized
+    bool checkTypeSignature(CharmFunction f, CHARM_LIST_TYPE& definition);
+    //the written down or inferred signature of a function. proven if its outputs definitely have those types
+    bool signatureOf(std::string fName, CharmTypeSignature& signature, bool& proven);
+
+    //run the optimization passes over a freshly parsed definition: constant folding
+    //(symbolically running the body on a stack of known values, evaluating pure
+    //builtins whose arguments are all known) and then superinstruction fusing
+    void optimizeDefinition(CharmFunction& f);
+    //which lists in a body are only ever run (by `i` or `ifthen`), and so can be optimized
+    static std::vector<bool> findCodeQuotations(const CHARM_LIST_TYPE& body);
+    std::string analysisReport(std::string fName);
+
+    void addAnnotation(std::string fName, std::string annotation);
+    //a builtin added by whoever is embedding charm (see Charm.h), so that calls to it
+    //aren't taken for calls to a definition. it's never pure: it could do anything
+    void addBuiltinFunction(std::string fName, std::function<void(Runner*)> f);
+    //memoize every pure recursive function with a type signature
+    void setMemoizeAll(bool m);
+    //fills in the memoization fields of info
+    void analyzeMemoization(CharmFunction f, CharmFunctionDefinitionInfo& info);
 };
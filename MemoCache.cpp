@@ -0,0 +1,56 @@
+#include "MemoCache.h"
+#include "ParserTypes.h"
+
+MemoCache::MemoCache(unsigned long long capacity) {
+	MemoCache::capacity = capacity;
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+}
+
+std::size_t MemoCache::hashArguments(const CHARM_LIST_TYPE& arguments) {
+	std::size_t out = arguments.size();
+	for (const CharmFunction& f : arguments) {
+		out ^= charmFunctionHash(f) + 0x9e3779b97f4a7c15ULL + (out << 6) + (out >> 2);
+	}
+	return out;
+}
+
+const CHARM_LIST_TYPE* MemoCache::lookup(const CHARM_LIST_TYPE& arguments) {
+	std::size_t hash = hashArguments(arguments);
+	auto range = index.equal_range(hash);
+	for (auto indexIter = range.first; indexIter != range.second; indexIter++) {
+		auto entry = indexIter->second;
+		if (entry->arguments == arguments) {
+			//move the entry to the front, it's the most recently used now
+			entries.splice(entries.begin(), entries, entry);
+			hits++;
+			return &(entry->results);
+		}
+	}
+	misses++;
+	return nullptr;
+}
+
+void MemoCache::insert(CHARM_LIST_TYPE arguments, CHARM_LIST_TYPE results) {
+	if (capacity == 0) return;
+	if (entries.size() >= capacity) {
+		//evict the least recently used entry
+		auto last = std::prev(entries.end());
+		auto range = index.equal_range(last->hash);
+		for (auto indexIter = range.first; indexIter != range.second; indexIter++) {
+			if (indexIter->second == last) {
+				index.erase(indexIter);
+				break;
+			}
+		}
+		entries.pop_back();
+		evictions++;
+	}
+	MemoEntry entry;
+	entry.hash = hashArguments(arguments);
+	entry.arguments = arguments;
+	entry.results = results;
+	entries.push_front(entry);
+	index.emplace(entry.hash, entries.begin());
+}
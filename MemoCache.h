@@ -0,0 +1,33 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+
+#include "ParserTypes.h"
+
+//a bounded LRU cache from the arguments a memoized function
+//took off of the stack to the results it left on the stack
+class MemoCache {
+private:
+	struct MemoEntry {
+		std::size_t hash;
+		CHARM_LIST_TYPE arguments;
+		CHARM_LIST_TYPE results;
+	};
+	//most recently used entries are at the front
+	std::list<MemoEntry> entries;
+	//entries are keyed by the hash of their arguments
+	std::unordered_multimap<std::size_t, std::list<MemoEntry>::iterator> index;
+	unsigned long long capacity;
+public:
+	MemoCache(unsigned long long capacity);
+
+	static std::size_t hashArguments(const CHARM_LIST_TYPE& arguments);
+
+	//returns nullptr on a miss
+	const CHARM_LIST_TYPE* lookup(const CHARM_LIST_TYPE& arguments);
+	void insert(CHARM_LIST_TYPE arguments, CHARM_LIST_TYPE results);
+
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+};
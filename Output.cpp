@@ -0,0 +1,91 @@
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "Output.h"
+
+OutputBuffer::OutputBuffer(int fd) : fd(fd), flushOnNewline(isatty(fd)) {}
+
+OutputBuffer::~OutputBuffer() {
+	flush();
+}
+
+void OutputBuffer::flushUnlocked() {
+	size_t written = 0;
+	while (written < used) {
+		ssize_t result = ::write(fd, buffer + written, used - written);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			//(nowhere to put it, so it's dropped like std::cout would)
+			break;
+		}
+		written += result;
+	}
+	used = 0;
+	newlineWritten = false;
+}
+
+void OutputBuffer::appendUnlocked(const char* data, size_t size) {
+	if (flushOnNewline && !newlineWritten && memchr(data, '\n', size) != nullptr) {
+		newlineWritten = true;
+	}
+	while (size > 0) {
+		if (used == BUFFER_SIZE) {
+			flushUnlocked();
+		}
+		size_t chunk = std::min(size, BUFFER_SIZE - used);
+		memcpy(buffer + used, data, chunk);
+		used += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+void OutputBuffer::appendValueUnlocked(const CharmFunction& f) {
+	writeCharmFunction(f, [this](const char* data, size_t size) {
+		appendUnlocked(data, size);
+		return true;
+	});
+}
+
+void OutputBuffer::finishWrite() {
+	if (newlineWritten) {
+		flushUnlocked();
+	}
+}
+
+void OutputBuffer::write(const char* data, size_t size) {
+	std::lock_guard<std::mutex> lock(mutex);
+	appendUnlocked(data, size);
+	finishWrite();
+}
+
+void OutputBuffer::write(const std::string& text) {
+	write(text.data(), text.size());
+}
+
+void OutputBuffer::writeValue(const CharmFunction& f, bool newline) {
+	std::lock_guard<std::mutex> lock(mutex);
+	appendValueUnlocked(f);
+	if (newline) {
+		appendUnlocked("\n", 1);
+	}
+	finishWrite();
+}
+
+void OutputBuffer::flush() {
+	std::lock_guard<std::mutex> lock(mutex);
+	flushUnlocked();
+}
+
+OutputBuffer& standardOutput() {
+	//(a function static, so it's there for anything that prints while the program starts up or exits)
+	static OutputBuffer out(STDOUT_FILENO);
+	return out;
+}
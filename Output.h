@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <cstddef>
+
+#include "ParserTypes.h"
+
+//where p, pstring and newline write to when the runner doesn't say otherwise (see Runner::output).
+//everything is collected in a big buffer and written straight to the file descriptor: after every
+//newline if it's a terminal, otherwise only when the buffer fills up, on flush(), and at exit.
+//anything else that writes to the same place has to flush() first, or it comes out of order
+class OutputBuffer {
+private:
+	static const size_t BUFFER_SIZE = 1 << 16;
+	char buffer[BUFFER_SIZE];
+	size_t used = 0;
+	int fd;
+	bool flushOnNewline;
+	//whether a newline has been written since the last flush
+	bool newlineWritten = false;
+	//(runners on different threads can share it)
+	std::mutex mutex;
+
+	void flushUnlocked();
+	void appendUnlocked(const char* data, size_t size);
+	void appendValueUnlocked(const CharmFunction& f);
+	void finishWrite();
+public:
+	OutputBuffer(int fd);
+	~OutputBuffer();
+	OutputBuffer(const OutputBuffer&) = delete;
+	OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+	void write(const char* data, size_t size);
+	void write(const std::string& text);
+	//formats f straight into the buffer (see writeCharmFunction)
+	void writeValue(const CharmFunction& f, bool newline = false);
+	void flush();
+};
+
+//the one for fd 1, flushed when the program exits
+OutputBuffer& standardOutput();
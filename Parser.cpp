@@ -6,6 +6,7 @@
 #include "ParserTypes.h"
 #include "Debug.h"
 #include "FunctionAnalyzer.h"
+#include "Profiler.h"
 #include "Error.h"
 
 
@@ -31,6 +32,18 @@ inline void Parser::rtrim(std::string &s) {
 Parser::Parser() {
 }
 
+FunctionAnalyzer* Parser::getFunctionAnalyzer() {
+	return &fA;
+}
+
+void Parser::setMemoizeAll(bool m) {
+	fA.setMemoizeAll(m);
+}
+
+void Parser::useProfile(std::string path) {
+	fA.setCallCounts(Profiler::readCallCounts(path));
+}
+
 bool Parser::isCharDigit(char c) {
 	std::string acceptableNumberChars = "-.0123456789";
 	for (auto checkNum : acceptableNumberChars) {
@@ -77,6 +90,33 @@ bool Parser::isLineTypeSignature(std::string line) {
 	return false;
 }
 
+bool Parser::isLineAnnotation(std::string line) {
+	std::stringstream lineS(line);
+	std::string f;
+	while (std::getline(lineS, f, ' ')) {
+		if (f == ":@") {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Parser::parseAnnotation(std::string line) {
+	//annotations look like `f :@ memoize`
+	auto atIndex = line.find(":@");
+	std::string functionName = line.substr(0, atIndex);
+	Parser::rtrim(functionName);
+	Parser::ltrim(functionName);
+	std::string annotationRest = line.substr(atIndex + 2);
+	std::string annotationToken;
+	while (Parser::advanceParse(annotationToken, annotationRest)) {
+		if (annotationToken == "") {
+			continue;
+		}
+		fA.addAnnotation(functionName, annotationToken);
+	}
+}
+
 CharmTypes Parser::tokenToType(std::string token) {
     if (token == "any") {
         return TYPESIG_ANY;
@@ -90,6 +130,8 @@ CharmTypes Parser::tokenToType(std::string token) {
         return TYPESIG_INT;
     } else if (token == "float") {
         return TYPESIG_FLOAT;
+    } else if (token == "map") {
+        return TYPESIG_MAP;
     } else {
         std::stringstream errorOut;
         errorOut << "Unrecognized type: " << token << std::endl;
@@ -139,18 +181,6 @@ CharmFunctionType Parser::recognizeFunction(std::string s) {
 	return DEFINED_FUNCTION;
 }
 
-CharmFunctionDefinitionInfo Parser::analyzeDefinition(CharmFunction f) {
-	CharmFunctionDefinitionInfo out;
-	//first, we fill in the info and see if the function is not recursive/inlineable
-	out.inlineable = fA.isInlinable(f);
-	//then we fill in the inlineDefinitions deque, for parsing future DEFINED_FUNCTIONs
-	if (out.inlineable) {
-		fA.addToInlineDefinitions(f);
-	}
-	out.tailCallRecursive = fA.isTailCallRecursive(f);
-	return out;
-}
-
 CharmFunction Parser::parseDefinition(std::string line) {
 	//if there was a function definition, do some weird stuff
 	//set functionType to FUNCTION_DEFINITION (duh)
@@ -171,14 +201,16 @@ CharmFunction Parser::parseDefinition(std::string line) {
 	currentFunction.functionName = nameAndDef.first;
 	ONLYDEBUG printf("FUNCTION IS NAMED %s\n", currentFunction.functionName.c_str());
 	ONLYDEBUG printf("FUNCTION BODY IS %s\n", nameAndDef.second.c_str());
-	currentFunction.literalFunctions = Parser::lex(nameAndDef.second).first;
+	//the body is lexed as written: the FunctionAnalyzer does the inlining, since it knows
+	//about every definition and can redo this one when something it calls changes
+	currentFunction.literalFunctions = Parser::lexAskToInline(nameAndDef.second, false).first;
 	//we outta here!
 
-	//then, we analyze the function before returning it
-	CharmFunctionDefinitionInfo functionInfo = Parser::analyzeDefinition(currentFunction);
-	currentFunction.definitionInfo = functionInfo;
+	//then, we analyze and optimize the function before returning it
+	currentFunction = fA.addDefinition(currentFunction);
 	ONLYDEBUG printf("IS %s INLINEABLE? %s\n", currentFunction.functionName.c_str(), currentFunction.definitionInfo.inlineable ? "Yes" : "No");
 	ONLYDEBUG printf("IS %s TAIL CALL RECURSIVE? %s\n", currentFunction.functionName.c_str(), currentFunction.definitionInfo.tailCallRecursive ? "Yes" : "No");
+	ONLYDEBUG printf("IS %s MEMOIZED? %s\n", currentFunction.functionName.c_str(), currentFunction.definitionInfo.memoized ? "Yes" : "No");
 	return currentFunction;
 }
 
@@ -217,12 +249,13 @@ CharmFunction Parser::parseStringFunction(std::string& token, std::string& rest)
         }
         outS << token << " ";
     }
-    out.stringValue = outS.str();
+    std::string outString = outS.str();
     //if our string is non-empty, there will be a final space pushed to it that
     //we don't want. delete it here.
-    if (out.stringValue.size() > 0) {
-        out.stringValue.erase(std::prev(out.stringValue.end()));
+    if (outString.size() > 0) {
+        outString.erase(std::prev(outString.end()));
     }
+    out.stringValue = outString;
 	//make sure that the final quote was removed if it exists
 	//(AKA we're not at the end of the line)
 	//FINALLY we can fill in out
@@ -291,8 +324,9 @@ void Parser::delegateParsing(CHARM_LIST_TYPE& out, std::string& token, std::stri
 	out.push_back(currentFunction);
 	if (DEBUGMODE) {
 		printf("AFTER 1 TOKEN, OUT NOW LOOKS LIKE THIS:\n     ");
-		for (CharmFunction f : out) {
-			printf("%s ", charmFunctionToString(f).c_str());
+		for (const CharmFunction& f : out) {
+			printCharmFunction(stdout, f);
+			printf(" ");
 		}
 		printf("\n");
 	}
@@ -303,12 +337,13 @@ bool Parser::advanceParse(std::string& token, std::string& rest) {
         return false;
     }
 	auto nextSpace = rest.find_first_of(' ');
+	//(in place, so that the strings' buffers get reused instead of making new ones for every token)
 	if (nextSpace == std::string::npos) {
-		token = rest;
-		rest = "";
+		token.swap(rest);
+		rest.clear();
 	} else {
-		token = rest.substr(0, nextSpace);
-		rest = rest.substr(nextSpace + 1);
+		token.assign(rest, 0, nextSpace);
+		rest.erase(0, nextSpace + 1);
 	}
     return true;
 }
@@ -325,9 +360,15 @@ std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*> Parser::lexAskToInline(const std::
 		if (isLineFunctionDefinition(line)) {
 			//deal with FUNCTION_DEFINITION
 			out.push_back(Parser::parseDefinition(line));
+			//and run the definitions that changed because of it again, so the runner gets the new versions
+			for (CharmFunction updated : fA.takeUpdatedDefinitions()) {
+				out.push_back(updated);
+			}
 		} else if (isLineTypeSignature(line)) {
             fA.addTypeSignature(Parser::parseTypeSignature(line));
-        } else {
+        } else if (isLineAnnotation(line)) {
+			Parser::parseAnnotation(line);
+		} else {
 			std::string rest = line;
 			std::string token;
 			while (Parser::advanceParse(token, rest)) {
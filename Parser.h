@@ -19,7 +19,9 @@ private:
 	bool isLineTypeSignature(std::string line);
 	CharmTypes tokenToType(std::string token);
 	CharmTypeSignature parseTypeSignature(std::string line);
-	CharmFunctionDefinitionInfo analyzeDefinition(CharmFunction f);
+
+	bool isLineAnnotation(std::string line);
+	void parseAnnotation(std::string line);
 
 	FunctionAnalyzer fA;
 
@@ -34,6 +36,11 @@ private:
 	CharmFunction parseListFunction(std::string& token, std::string& rest);
 public:
 	Parser();
+	//memoize every pure, recursive function with a type signature
+	void setMemoizeAll(bool m);
+	FunctionAnalyzer* getFunctionAnalyzer();
+	//use the call counts from a profile to decide what's worth inlining
+	void useProfile(std::string path);
 	std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*> lex(const std::string charmInput);
 	std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*> lexAskToInline(const std::string charmInput, bool willInline);
 };
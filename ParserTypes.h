@@ -4,13 +4,25 @@
 #include <vector>
 #include <deque>
 #include <variant>
+#include <functional>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include "CharmString.h"
+#include "CharmList.h"
+#include "CharmSymbol.h"
+#include "CharmPool.h"
 
 #ifndef CHARM_STACK_TYPE
-	#define CHARM_STACK_TYPE std::deque<CharmFunction>
+	#define CHARM_STACK_TYPE std::deque<CharmFunction, CharmPoolAllocator<CharmFunction>>
 #endif
 
 #ifndef CHARM_LIST_TYPE
-	#define CHARM_LIST_TYPE std::vector<CharmFunction>
+	#define CHARM_LIST_TYPE CharmList<CharmFunction>
 #endif
 
 
@@ -20,7 +32,8 @@ enum CharmTypes {
 	TYPESIG_LISTSTRING,
 	TYPESIG_STRING,
 	TYPESIG_INT,
-	TYPESIG_FLOAT
+	TYPESIG_FLOAT,
+	TYPESIG_MAP
 };
 struct CharmTypeSignature {
 	std::string functionName;
@@ -37,10 +50,12 @@ enum CharmFunctionType {
 				    //to deal with
 	NUMBER_FUNCTION, //pushes number on stack
 	STRING_FUNCTION, //pushes string on stack
-	DEFINED_FUNCTION //built in function like
-	                 //dup, pop, i
-					 //or for preprocessing the
-					 //definitions
+	DEFINED_FUNCTION, //built in function like
+	                  //dup, pop, i
+					  //or for preprocessing the
+					  //definitions
+	MAP_FUNCTION //a hash map from functions to functions,
+	             //made by mnew (there are no map literals)
 };
 
 enum CharmNumberType {
@@ -56,69 +71,191 @@ struct CharmNumber {
 	//and integers, we add both
 };
 
+//the most arguments a definition can have checked against its type signature
+static const unsigned int MAX_CHECKED_POPS = 8;
 struct CharmFunctionDefinitionInfo {
 	bool inlineable;
 	bool tailCallRecursive;
+	//memoized functions cache their results, keyed by the
+	//memoizedPops values they take off the stack
+	bool memoized;
+	unsigned long long memoizedPops;
+	unsigned long long memoizedPushes;
+	//the types (deepest first) that a definition specialized on its type signature relies on,
+	//checked when it's called. every CharmFunction carries one of these, so it's a fixed array
+	unsigned int checkedPopsCount;
+	CharmTypes checkedPops[MAX_CHECKED_POPS];
 };
+struct CharmMap;
 struct CharmFunction {
 	CharmFunctionType functionType;
 	//ONLY USED WITH STRING_FUNCTION
-	std::string stringValue;
+	CharmString stringValue;
 	//ONLY USED WITH NUMBER_FUNCTION
 	CharmNumber numberValue;
 	//ONLY USED WITH LIST_FUNCTION AND FUNCTION_DEFINITION
 	CHARM_LIST_TYPE literalFunctions;
 	//ONLY USED WITH DEFINED_FUNCTION AND FUNCTION_DEFINITION
-	std::string functionName;
+	CharmSymbol functionName;
 	//ONLY USED WITH FUNCTION_DEFINITION
 	CharmFunctionDefinitionInfo definitionInfo;
+	//ONLY USED WITH MAP_FUNCTION. shared between copies, see CharmMap
+	std::shared_ptr<CharmMap> mapValue;
+};
+
+//(defined below, the map needs them for its keys)
+inline std::size_t charmFunctionHash(const CharmFunction& f);
+inline bool operator==(const CharmFunction& lhs, const CharmFunction& rhs);
+struct CharmFunctionHasher {
+	std::size_t operator()(const CharmFunction& f) const {
+		return charmFunctionHash(f);
+	}
+};
+//a map is copy on write: dup and friends copy the pointer, and the builtins that change
+//a map copy it first if anything else has a pointer to it too (see PredefinedFunctions.cpp)
+struct CharmMap {
+	std::unordered_map<CharmFunction, CharmFunction, CharmFunctionHasher> entries;
 };
-inline std::string charmFunctionToString(CharmFunction f) {
-	std::stringstream out;
+//how much of a value gets written out, for previews (0 is no limit). lists nested deeper than
+//depth are written as `[ ... ]`, and only the first width functions of a list (or characters
+//of a string) are written, followed by `...`
+struct CharmPreviewLimits {
+	unsigned int depth = 0;
+	unsigned long long width = 0;
+};
+//for the REPL prompt, the GUI's stack view and error messages
+const CharmPreviewLimits PREVIEW_LIMITS = { 4, 32 };
+
+//writes f out the way charm reads it, a piece at a time, through write(const char* data, size_t size).
+//write returns false once it doesn't want any more, and then this stops and returns false too.
+//nothing is allocated or copied along the way
+template <typename Write>
+bool writeCharmFunction(const CharmFunction& f, Write&& write, const CharmPreviewLimits& limits = CharmPreviewLimits(), unsigned int depth = 0) {
 	switch (f.functionType) {
 		case FUNCTION_DEFINITION:
-		out << f.functionName << ":=";
-		for (CharmFunction fs : f.literalFunctions) {
-			out << charmFunctionToString(fs) << " ";
+		if (!write(f.functionName.data(), f.functionName.size()) || !write(":=", 2)) return false;
+		for (const CharmFunction& fs : f.literalFunctions) {
+			if (!writeCharmFunction(fs, write, limits, depth + 1) || !write(" ", 1)) return false;
 		}
-		break;
+		return true;
 
 		case LIST_FUNCTION:
-		out << "[ ";
-		for (CharmFunction fs : f.literalFunctions) {
-			out << charmFunctionToString(fs) << " ";
+		if (!write("[ ", 2)) return false;
+		if (limits.depth > 0 && depth >= limits.depth && f.literalFunctions.size() > 0) {
+			if (!write("... ", 4)) return false;
+		} else {
+			for (unsigned long long n = 0; n < f.literalFunctions.size(); n++) {
+				if (limits.width > 0 && n >= limits.width) {
+					if (!write("... ", 4)) return false;
+					break;
+				}
+				if (!writeCharmFunction(f.literalFunctions[n], write, limits, depth + 1) || !write(" ", 1)) return false;
+			}
 		}
-		out << "]";
-		break;
+		return write("]", 1);
 
-		case NUMBER_FUNCTION:
-		switch (f.numberValue.whichType) {
-			case INTEGER_VALUE:
-			out << f.numberValue.integerValue;
-			break;
+		case NUMBER_FUNCTION: {
+			//(long enough for any long long, or a long double written with %Lg)
+			char number[64];
+			int length = 0;
+			switch (f.numberValue.whichType) {
+				case INTEGER_VALUE:
+				length = std::to_chars(number, number + sizeof(number), f.numberValue.integerValue).ptr - number;
+				break;
 
-			case FLOAT_VALUE:
-			out << f.numberValue.floatValue;
-			break;
+				case FLOAT_VALUE:
+				//(what std::ostream does with a long double)
+				length = snprintf(number, sizeof(number), "%Lg", f.numberValue.floatValue);
+				break;
+			}
+			return write(number, length);
 		}
-		break;
 
 		case STRING_FUNCTION:
-		out << "\" " << f.stringValue << " \"";
-		break;
+		if (!write("\" ", 2)) return false;
+		{
+			//(a piece at a time, so that a rope doesn't have to be flattened to be written)
+			bool truncated = limits.width > 0 && f.stringValue.size() > limits.width;
+			unsigned long long remaining = truncated ? limits.width : f.stringValue.size();
+			bool written = true;
+			f.stringValue.forEachChunk([&](const char* data, size_t size) {
+				size_t piece = std::min<unsigned long long>(size, remaining);
+				remaining -= piece;
+				written = write(data, piece);
+				return written && remaining > 0;
+			});
+			if (!written || (truncated && !write("...", 3))) return false;
+		}
+		return write(" \"", 2);
 
 		case DEFINED_FUNCTION:
-		out << f.functionName;
-		break;
+		return write(f.functionName.data(), f.functionName.size());
+
+		case MAP_FUNCTION: {
+			//written as the keys and values one after the other, in no particular order
+			if (!write("{ ", 2)) return false;
+			if (limits.depth > 0 && depth >= limits.depth && f.mapValue->entries.size() > 0) {
+				if (!write("... ", 4)) return false;
+			} else {
+				unsigned long long n = 0;
+				for (const auto& entry : f.mapValue->entries) {
+					if (limits.width > 0 && n++ >= limits.width) {
+						if (!write("... ", 4)) return false;
+						break;
+					}
+					if (!writeCharmFunction(entry.first, write, limits, depth + 1) || !write(" ", 1)) return false;
+					if (!writeCharmFunction(entry.second, write, limits, depth + 1) || !write(" ", 1)) return false;
+				}
+			}
+			return write("}", 1);
+		}
+	}
+	return true;
+}
+
+inline std::string charmFunctionToString(const CharmFunction& f, const CharmPreviewLimits& limits = CharmPreviewLimits()) {
+	std::string out;
+	writeCharmFunction(f, [&out](const char* data, size_t size) {
+		out.append(data, size);
+		return true;
+	}, limits);
+	return out;
+}
+
+//writes as much of f as fits into buffer (NUL terminated, like snprintf), returns how much that was
+inline size_t charmFunctionToBuffer(const CharmFunction& f, char* buffer, size_t size, const CharmPreviewLimits& limits = CharmPreviewLimits()) {
+	if (size == 0) {
+		return 0;
 	}
-	return out.str();
+	size_t used = 0;
+	writeCharmFunction(f, [buffer, size, &used](const char* data, size_t dataSize) {
+		size_t fits = std::min(dataSize, size - 1 - used);
+		memcpy(buffer + used, data, fits);
+		used += fits;
+		return fits == dataSize;
+	}, limits);
+	buffer[used] = '\0';
+	return used;
+}
+
+//for the debug tracing
+inline void printCharmFunction(FILE* file, const CharmFunction& f) {
+	writeCharmFunction(f, [file](const char* data, size_t size) {
+		return fwrite(data, 1, size, file) == size;
+	});
 }
 
 inline bool operator==(const CharmFunction& lhs, const CharmFunction& rhs){
 	if (lhs.functionType == rhs.functionType) {
 		switch (lhs.functionType) {
 			case LIST_FUNCTION:
-			if (lhs.literalFunctions.size() != rhs.literalFunctions.size()) {
+			if (lhs.literalFunctions.sharesWith(rhs.literalFunctions)) {
+				//(copies of the same list)
+				return true;
+			} else if (lhs.literalFunctions.size() != rhs.literalFunctions.size()) {
+				return false;
+			} else if (charmFunctionHash(lhs) != charmFunctionHash(rhs)) {
+				//lists remember their hashes, so after the first time this is O(1)
 				return false;
 			} else {
 				for (unsigned long long n = 0; n < lhs.literalFunctions.size(); n++) {
@@ -153,6 +290,21 @@ inline bool operator==(const CharmFunction& lhs, const CharmFunction& rhs){
 			case FUNCTION_DEFINITION:
 			return (lhs.functionName == rhs.functionName);
 			break;
+
+			case MAP_FUNCTION:
+			if (lhs.mapValue == rhs.mapValue) {
+				return true;
+			}
+			if (lhs.mapValue->entries.size() != rhs.mapValue->entries.size()) {
+				return false;
+			}
+			for (const auto& entry : lhs.mapValue->entries) {
+				auto found = rhs.mapValue->entries.find(entry.first);
+				if (found == rhs.mapValue->entries.end() || !(found->second == entry.second)) {
+					return false;
+				}
+			}
+			return true;
 		}
 	} else {
 		return false;
@@ -161,6 +313,55 @@ inline bool operator==(const CharmFunction& lhs, const CharmFunction& rhs){
 	return false;
 }
 
+//structural hash, consistent with operator==
+inline std::size_t charmFunctionHash(const CharmFunction& f) {
+	std::size_t out = std::hash<int>()(f.functionType);
+	auto combine = [&out](std::size_t h) {
+		out ^= h + 0x9e3779b97f4a7c15ULL + (out << 6) + (out >> 2);
+	};
+	switch (f.functionType) {
+		case LIST_FUNCTION:
+		//(worked out once, and then remembered by the list and all of its copies)
+		combine(f.literalFunctions.hash([](const CHARM_LIST_TYPE::vector_type& items) {
+			std::size_t itemsHash = 0;
+			for (const CharmFunction& fs : items) {
+				itemsHash ^= charmFunctionHash(fs) + 0x9e3779b97f4a7c15ULL + (itemsHash << 6) + (itemsHash >> 2);
+			}
+			return itemsHash;
+		}));
+		break;
+
+		case NUMBER_FUNCTION:
+		if (f.numberValue.whichType == INTEGER_VALUE) {
+			combine(std::hash<long long>()(f.numberValue.integerValue));
+		} else if (f.numberValue.floatValue != 0) {
+			//0.0 and -0.0 compare equal, so they can't hash differently
+			combine(std::hash<long double>()(f.numberValue.floatValue));
+		}
+		break;
+
+		case STRING_FUNCTION:
+		combine(f.stringValue.hash());
+		break;
+
+		case DEFINED_FUNCTION:
+		case FUNCTION_DEFINITION:
+		combine(f.functionName.hash());
+		break;
+
+		case MAP_FUNCTION: {
+			//the entries are in no particular order, so they're combined in a way that doesn't care
+			std::size_t entries = 0;
+			for (const auto& entry : f.mapValue->entries) {
+				entries += charmFunctionHash(entry.first) * 31 + charmFunctionHash(entry.second);
+			}
+			combine(entries);
+			break;
+		}
+	}
+	return out;
+}
+
 
 //ALL DEFINITIONS ARE CONSTANTS
 struct CharmDefinition {
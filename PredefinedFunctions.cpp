@@ -5,6 +5,11 @@
 #include <unordered_map>
 #include <functional>
 #include <utility>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <limits>
 
 #include "PredefinedFunctions.h"
 #include "ParserTypes.h"
@@ -12,71 +17,323 @@
 #include "Debug.h"
 #include "Runner.h"
 #include "FunctionAnalyzer.h"
+#include "Superinstructions.h"
 
 #ifdef CHARM_GUI
 #include "gui.h"
+
+static void display_value(const CharmFunction& f, bool newline) {
+	display_output(charmFunctionToString(f) + (newline ? "\n" : ""));
+}
 #else
-static void display_output(std::string output) {
-	std::cout << output;
+#include "Output.h"
+
+static void display_output(const std::string& output) {
+	standardOutput().write(output);
+}
+
+static void display_value(const CharmFunction& f, bool newline) {
+	standardOutput().writeValue(f, newline);
 }
 
 static std::string get_input_line() {
+	//(whatever's been written is probably asking for this line)
+	standardOutput().flush();
 	std::string result;
 	std::getline(std::cin, result);
 	return result;
 }
 #endif
 
-void PredefinedFunctions::addBuiltinFunction(std::string n, std::function<void(Runner*)> f) {
+//output goes wherever the runner says it should
+static void output(Runner* r, std::string text) {
+	if (r->output) {
+		r->output(text);
+	} else {
+		display_output(text);
+	}
+}
+
+//and values are formatted straight into the output buffer when there is one
+static void outputValue(Runner* r, const CharmFunction& f, bool newline = false) {
+	if (r->output) {
+		r->output(charmFunctionToString(f) + (newline ? "\n" : ""));
+	} else {
+		display_value(f, newline);
+	}
+}
+
+void PredefinedFunctions::addBuiltinFunction(std::string n, std::function<void(Runner*)> f, bool pure) {
 	BuiltinFunction bf;
-	bf.f = f; bf.takesContext = false;
+	bf.f = f; bf.takesContext = false; bf.pure = pure;
 	cppFunctionNames[n] = bf;
+	builtinNames.insert(n);
 }
-void PredefinedFunctions::addBuiltinFunction(std::string n, std::function<void(Runner*, RunnerContext*)> f) {
+void PredefinedFunctions::addBuiltinFunction(std::string n, std::function<void(Runner*, RunnerContext*)> f, bool pure) {
 	BuiltinFunction bf;
-	bf.f = f; bf.takesContext = true;
+	bf.f = f; bf.takesContext = true; bf.pure = pure;
 	cppFunctionNames[n] = bf;
+	builtinNames.insert(n);
 }
-void PredefinedFunctions::functionLookup(std::string functionName, Runner* r, RunnerContext* context) {
-	auto f = cppFunctionNames.at(functionName);
+bool PredefinedFunctions::isBuiltinFunction(CharmSymbol n) {
+	return (cppFunctionNames.find(n) != cppFunctionNames.end());
+}
+bool PredefinedFunctions::isPureBuiltinFunction(CharmSymbol n) {
+	auto f = cppFunctionNames.find(n);
+	return (f != cppFunctionNames.end()) && f->second.pure;
+}
+void PredefinedFunctions::functionLookup(CharmSymbol functionName, Runner* r, RunnerContext* context) {
+	run(cppFunctionNames.at(functionName), r, context);
+}
+void PredefinedFunctions::run(const BuiltinFunction& f, Runner* r, RunnerContext* context) {
 	if (f.takesContext) {
-		auto castF = std::get<std::function<void(Runner*, RunnerContext*)>>(f.f);
-		castF(r, context);
+		std::get<std::function<void(Runner*, RunnerContext*)>>(f.f)(r, context);
+	} else {
+		std::get<std::function<void(Runner*)>>(f.f)(r);
+	}
+}
+
+//these are shared between builtins and the superinstructions that use them
+static void concat(Runner* r) {
+	//get first list
+	CharmFunction f1 = r->getCurrentStack()->pop();
+	//get second list (first in order of concatination), which is added onto where it is
+	CharmFunction& f2 = r->getCurrentStack()->top();
+	//make sure they're both lists or strings
+	if ((f1.functionType == LIST_FUNCTION) && (f2.functionType == LIST_FUNCTION)) {
+		f2.literalFunctions.insert(f2.literalFunctions.end(), f1.literalFunctions.cbegin(), f1.literalFunctions.cend());
+	} else if ((f1.functionType == STRING_FUNCTION) && (f2.functionType == STRING_FUNCTION)) {
+		f2.stringValue.append(f1.stringValue);
 	} else {
-		auto castF = std::get<std::function<void(Runner*)>>(f.f);
-		castF(r);
+		runtime_die("Unmatching types passed to `concat`.");
+	}
+}
+
+static void copyFrom(Runner* r) {
+	//the prelude's copyfrom:
+	//" copyfromref " flip setref 0 " copyfromref " getref swap dup 1 " copyfromref " getref 1 + swap
+	CharmFunction f1 = r->getCurrentStack()->pop();
+	//(made once, instead of a new string every time)
+	static const CharmFunction refName = []() {
+		CharmFunction name;
+		name.functionType = STRING_FUNCTION;
+		name.stringValue = "copyfromref";
+		name.stringValue.flatten();
+		return name;
+	}();
+	r->setReference(refName, f1);
+	if (!Stack::isInt(f1)) {
+		runtime_die("Non integer passed to `swap`.");
+	}
+	if (f1.numberValue.integerValue < 0) {
+		runtime_die("Negative int passed to `swap`.");
+	}
+	if (f1.numberValue.integerValue + 1 >= r->MAX_STACK) {
+		runtime_die("Overflowing pointers passed to `swap`.");
+	}
+	Stack* stack = r->getCurrentStack();
+	stack->push(stack->at(f1.numberValue.integerValue));
+}
+
+//the map on top of the stack, for a builtin that's going to change it where it is. maps are shared
+//between copies (dup just copies the pointer), so it's copied first unless nothing else can see it
+static CharmFunction& writableMap(Runner* r, const char* name) {
+	CharmFunction& f = r->getCurrentStack()->top();
+	if (f.functionType != MAP_FUNCTION) {
+		runtime_die("Non map passed to `" + std::string(name) + "`.");
+	}
+	if (f.mapValue.use_count() != 1) {
+		f.mapValue = std::make_shared<CharmMap>(*f.mapValue);
+	}
+	return f;
+}
+
+//lists shorter than this are sorted on one thread (starting threads costs more than it saves)
+static const size_t PARALLEL_SORT_SIZE = 1 << 15;
+
+//a stable merge sort with one comparator per thread: as many pieces as there are comparators
+//are sorted on their own threads, and then merged in pairs (each pair on its own thread) until
+//there's one left. a comparator can throw, and then the first thing one threw is thrown from
+//here once every thread has stopped
+template <typename T, typename Less>
+static void mergeSort(std::vector<T>& items, const std::vector<Less>& less) {
+	size_t jobs = less.size();
+	if (jobs < 2 || items.size() < PARALLEL_SORT_SIZE) {
+		std::stable_sort(items.begin(), items.end(), less[0]);
+		return;
+	}
+	std::vector<size_t> bounds;
+	for (size_t n = 0; n <= jobs; n++) {
+		bounds.push_back(items.size() * n / jobs);
+	}
+	std::vector<std::exception_ptr> errors(jobs);
+	auto inParallel = [&](size_t count, std::function<void(size_t)> job) {
+		std::vector<std::thread> pool;
+		for (size_t n = 0; n < count; n++) {
+			pool.emplace_back([&, n]() {
+				try {
+					job(n);
+				} catch (...) {
+					errors[n] = std::current_exception();
+				}
+			});
+		}
+		for (std::thread& worker : pool) {
+			worker.join();
+		}
+		for (std::exception_ptr& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+		}
+	};
+	inParallel(jobs, [&](size_t n) {
+		std::stable_sort(items.begin() + bounds[n], items.begin() + bounds[n + 1], less[n]);
+	});
+	while (bounds.size() > 2) {
+		//(an odd one out on the end waits for the next round)
+		inParallel((bounds.size() - 1) / 2, [&](size_t n) {
+			std::inplace_merge(items.begin() + bounds[2 * n], items.begin() + bounds[2 * n + 1], items.begin() + bounds[2 * n + 2], less[n]);
+		});
+		std::vector<size_t> merged;
+		for (size_t n = 0; n < bounds.size(); n += 2) {
+			merged.push_back(bounds[n]);
+		}
+		if (merged.back() != bounds.back()) {
+			merged.push_back(bounds.back());
+		}
+		bounds = merged;
+	}
+}
+
+//how many threads a big list is sorted on
+static std::atomic<unsigned int> sortJobsSetting(0);
+
+void PredefinedFunctions::setSortJobs(unsigned int jobs) {
+	sortJobsSetting = jobs;
+}
+
+static size_t sortJobs() {
+	unsigned int jobs = sortJobsSetting;
+	if (jobs == 0) {
+		jobs = std::thread::hardware_concurrency();
+	}
+	return std::max(1u, jobs);
+}
+
+//the order sort puts things in: numbers (by value, ints and floats together, NaN last) before
+//strings (byte by byte). strings have to have been flattened already, see sortList
+static bool sortsBefore(const CharmFunction& a, const CharmFunction& b) {
+	if (a.functionType != b.functionType) {
+		return a.functionType == NUMBER_FUNCTION;
+	}
+	if (a.functionType == STRING_FUNCTION) {
+		return a.stringValue.str() < b.stringValue.str();
+	}
+	if (a.numberValue.whichType == INTEGER_VALUE && b.numberValue.whichType == INTEGER_VALUE) {
+		return a.numberValue.integerValue < b.numberValue.integerValue;
+	}
+	//(a long double holds any long long exactly)
+	long double x = (a.numberValue.whichType == INTEGER_VALUE) ? a.numberValue.integerValue : a.numberValue.floatValue;
+	long double y = (b.numberValue.whichType == INTEGER_VALUE) ? b.numberValue.integerValue : b.numberValue.floatValue;
+	if (x != x) {
+		return false;
+	}
+	return (y != y) || x < y;
+}
+
+static CharmFunction sortList(CharmFunction list) {
+	bool allInts = true;
+	for (CharmFunction& f : list.literalFunctions) {
+		if (f.functionType == STRING_FUNCTION) {
+			//(so that the comparisons on other threads don't flatten anything)
+			f.stringValue.flatten();
+		} else if (f.functionType != NUMBER_FUNCTION) {
+			runtime_die("List with a non number or string in it passed to `sort`.");
+		}
+		allInts = allInts && f.functionType == NUMBER_FUNCTION && f.numberValue.whichType == INTEGER_VALUE;
+	}
+	if (allInts) {
+		//equal ints can't be told apart, so only the numbers need sorting
+		std::vector<long long> numbers;
+		numbers.reserve(list.literalFunctions.size());
+		for (const CharmFunction& f : list.literalFunctions) {
+			numbers.push_back(f.numberValue.integerValue);
+		}
+		mergeSort(numbers, std::vector<std::less<long long>>(sortJobs()));
+		for (size_t n = 0; n < numbers.size(); n++) {
+			list.literalFunctions[n].numberValue.integerValue = numbers[n];
+		}
+		return list;
+	}
+	//everything else is sorted by pointer, and moved into place at the end
+	std::vector<CharmFunction*> order;
+	order.reserve(list.literalFunctions.size());
+	for (CharmFunction& f : list.literalFunctions) {
+		order.push_back(&f);
+	}
+	auto less = [](const CharmFunction* a, const CharmFunction* b) {
+		return sortsBefore(*a, *b);
+	};
+	mergeSort(order, std::vector<decltype(less)>(sortJobs(), less));
+	CharmFunction out;
+	out.functionType = LIST_FUNCTION;
+	out.literalFunctions.reserve(order.size());
+	for (CharmFunction* f : order) {
+		out.literalFunctions.push_back(std::move(*f));
 	}
+	return out;
 }
 
+//runs the comparator passed to sortby on r's current stack
+struct SortbyLess {
+	Runner* r;
+	const CHARM_LIST_TYPE* comparator;
+	FunctionAnalyzer* fA;
+	//a goes before b if the comparator doesn't say that b goes after a
+	bool operator()(const CharmFunction* a, const CharmFunction* b) const {
+		r->getCurrentStack()->push(*b);
+		r->getCurrentStack()->push(*a);
+		r->run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>(*comparator, fA));
+		CharmFunction result = r->getCurrentStack()->pop();
+		if (result.functionType != NUMBER_FUNCTION || result.numberValue.whichType != INTEGER_VALUE) {
+			runtime_die("`sortby` comparator returned non integer.");
+		}
+		return result.numberValue.integerValue > 0;
+	}
+};
+
 PredefinedFunctions::PredefinedFunctions() {
 	/*************************************
 	INPUT / OUTPUT
 	*************************************/
+	//anything with side effects outside of the current stack
+	//is registered as impure (pure = false), see FunctionAnalyzer::isPure
 	addBuiltinFunction("p", [](Runner* r) {
-		display_output(charmFunctionToString(r->getCurrentStack()->pop()));
-	});
+		outputValue(r, r->getCurrentStack()->pop());
+	}, false);
 	addBuiltinFunction("pstring", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
 		if (f1.functionType == STRING_FUNCTION) {
-			display_output(f1.stringValue);
+			output(r, f1.stringValue.str());
 		} else {
 			runtime_die("Non string passed to `pstring`.");
 		}
-	});
+	}, false);
 	addBuiltinFunction("newline", [](Runner* r) {
-		display_output("\n");
-	});
+		output(r, "\n");
+	}, false);
 	addBuiltinFunction("getline", [](Runner* r) {
-		CharmFunction input;
+		CharmFunction& input = r->getCurrentStack()->emplace();
 		input.functionType = STRING_FUNCTION;
 		input.stringValue = get_input_line();
-		r->getCurrentStack()->push(input);
-	});
+	}, false);
 	/*************************************
 	DEBUGGING FUNCTIONS
 	*************************************/
 	addBuiltinFunction("type", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
+		//(looked at where it is, since it stays on the stack)
+		const CharmFunction& f1 = r->getCurrentStack()->top();
 		CharmFunction out;
 		out.functionType = STRING_FUNCTION;
 		switch (f1.functionType) {
@@ -99,29 +356,28 @@ PredefinedFunctions::PredefinedFunctions() {
 			case FUNCTION_DEFINITION:
 			out.stringValue = "FUNCTION_DEFINITION";
 			break;
+
+			case MAP_FUNCTION:
+			out.stringValue = "MAP_FUNCTION";
+			break;
 		}
-		r->getCurrentStack()->push(f1);
-		r->getCurrentStack()->push(out);
+		r->getCurrentStack()->push(std::move(out));
 	});
 	/*************************************
 	COMPARISONS
 	*************************************/
 	addBuiltinFunction("eq", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction f2 = r->getCurrentStack()->pop();
-		CharmFunction out;
-		out.functionType = NUMBER_FUNCTION;
-		out.numberValue.whichType = INTEGER_VALUE;
-		out.numberValue.integerValue = f1 == f2 ? 1 : 0;
-		r->getCurrentStack()->push(out);
+		CharmFunction& f2 = r->getCurrentStack()->top();
+		bool equal = f1 == f2;
+		f2 = Stack::intF(equal ? 1 : 0);
 	});
 	/*************************************
 	ATIONS
 	*************************************/
 	addBuiltinFunction("dup", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
-		r->getCurrentStack()->push(f1);
-		r->getCurrentStack()->push(f1);
+		Stack* stack = r->getCurrentStack();
+		stack->push(stack->at(0));
 	});
 	addBuiltinFunction("pop", [](Runner* r) {
 		r->getCurrentStack()->pop();
@@ -146,33 +402,28 @@ PredefinedFunctions::PredefinedFunctions() {
 	TRAVERSABLE (STRING / LIST) MANIPULATIONS
 	*************************************/
 	addBuiltinFunction("len", [](Runner* r) {
-		//list to check length of
-		CharmFunction f1 = r->getCurrentStack()->pop();
-		//push list back on because we dont need to get rid of it
-		r->getCurrentStack()->push(f1);
-		CharmFunction out;
-		out.functionType = NUMBER_FUNCTION;
-		CharmNumber num;
-		num.whichType = INTEGER_VALUE;
+		//list to check length of (left where it is, because we dont need to get rid of it)
+		const CharmFunction& f1 = r->getCurrentStack()->top();
+		long long length;
 		//make sure f1 is a list or string
 		if (f1.functionType == LIST_FUNCTION) {
-			num.integerValue = f1.literalFunctions.size();
+			length = f1.literalFunctions.size();
 		} else if (f1.functionType == STRING_FUNCTION) {
-			num.integerValue = f1.stringValue.size();
+			length = f1.stringValue.size();
+		} else if (f1.functionType == MAP_FUNCTION) {
+			length = f1.mapValue->entries.size();
 		} else {
 			//so if it's a bad type, i was going to just report a len of 0 or 1
 			//but i feel like that would be really misleading. eh, i'll just do 1
-			num.integerValue = 1;
+			length = 1;
 		}
-		out.numberValue = num;
-		r->getCurrentStack()->push(out);
+		r->getCurrentStack()->push(Stack::intF(length));
 	});
 	addBuiltinFunction("at", [](Runner* r) {
 		//index number
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		//list / string
-		CharmFunction f2 = r->getCurrentStack()->pop();
-		r->getCurrentStack()->push(f2);
+		//list / string, which stays where it is
+		const CharmFunction& f2 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1)) {
 			CharmFunction out;
 			if (f2.functionType == LIST_FUNCTION) {
@@ -186,11 +437,11 @@ PredefinedFunctions::PredefinedFunctions() {
 					runtime_die("Empty string passed to `at`.");
 				}
 				out.functionType = STRING_FUNCTION;
-				out.stringValue = f2.stringValue[f1.numberValue.integerValue % f2.stringValue.size()];
+				out.stringValue = CharmString::character(f2.stringValue[f1.numberValue.integerValue % f2.stringValue.size()]);
 			} else {
 				runtime_die("Neither a list nor a string was passed to `at`");
 			}
-			r->getCurrentStack()->push(out);
+			r->getCurrentStack()->push(std::move(out));
 		} else {
 			runtime_die("Non integer index passed to `at`");
 		}
@@ -200,18 +451,21 @@ PredefinedFunctions::PredefinedFunctions() {
 		CharmFunction f1 = r->getCurrentStack()->pop();
 		//get element to insert
 		CharmFunction f2 = r->getCurrentStack()->pop();
-		//get list or string
-		CharmFunction f3 = r->getCurrentStack()->pop();
+		//get list or string, which is inserted into where it is
+		CharmFunction& f3 = r->getCurrentStack()->top();
 		//make sure f1 is an int
 		if (!Stack::isInt(f1))
 			runtime_die("Non integer index passed to `insert`.");
 		if (f3.functionType == LIST_FUNCTION) {
 			//only allow a list to be inserted into a list
 			if (f2.functionType == LIST_FUNCTION) {
+				if (f3.literalFunctions.size() < 1) {
+					runtime_die("Empty list passed to `insert`.");
+				}
 				f3.literalFunctions.insert(
-					f3.literalFunctions.begin() + (f1.numberValue.integerValue % f3.literalFunctions.size()),
-					f2.literalFunctions.begin(),
-					f2.literalFunctions.end()
+					f3.literalFunctions.cbegin() + (f1.numberValue.integerValue % f3.literalFunctions.size()),
+					f2.literalFunctions.cbegin(),
+					f2.literalFunctions.cend()
 				);
 			} else {
 				runtime_die("Attempted to `insert` a non list into a list.");
@@ -219,6 +473,9 @@ PredefinedFunctions::PredefinedFunctions() {
 		} else if (f3.functionType == STRING_FUNCTION) {
 			//only allow a string to be inserted into another string
 			if (f2.functionType == STRING_FUNCTION) {
+				if (f3.stringValue.size() < 1) {
+					runtime_die("Empty string passed to `insert`.");
+				}
 				f3.stringValue.insert(
 					f1.numberValue.integerValue % f3.stringValue.size(),
 					f2.stringValue
@@ -227,75 +484,61 @@ PredefinedFunctions::PredefinedFunctions() {
 				runtime_die("Attempted to `insert` a non string into a string.");
 			}
 		}
-		r->getCurrentStack()->push(f3);
-	});
-	addBuiltinFunction("concat", [](Runner* r) {
-		//get first list
-		CharmFunction f1 = r->getCurrentStack()->pop();
-		//get second list (first in order of concatination)
-		CharmFunction f2 = r->getCurrentStack()->pop();
-		//make sure they're both lists or strings
-		if ((f1.functionType == LIST_FUNCTION) && (f2.functionType == LIST_FUNCTION)) {
-			f2.literalFunctions.insert(f2.literalFunctions.end(), f1.literalFunctions.begin(), f1.literalFunctions.end());
-		} else if ((f1.functionType == STRING_FUNCTION) && (f2.functionType == STRING_FUNCTION)) {
-			f2.stringValue = f2.stringValue + f1.stringValue;
-		} else {
-			runtime_die("Unmatching types passed to `concat`.");
-		}
-		r->getCurrentStack()->push(f2);
 	});
+	addBuiltinFunction("concat", concat);
 	addBuiltinFunction("split", [](Runner* r) {
 		//get split index
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		//get list/string to split
-		CharmFunction f2 = r->getCurrentStack()->pop();
+		//get list/string to split (the low half replaces it)
+		CharmFunction& f2 = r->getCurrentStack()->top();
 		CharmFunction lowOut;
 		CharmFunction highOut;
 		if (f1.functionType == NUMBER_FUNCTION && f1.numberValue.whichType == INTEGER_VALUE) {
 			//bounds checking
-			if (f1.numberValue.integerValue < 0 || (unsigned long long)f1.numberValue.integerValue > f2.literalFunctions.size()) {
+			unsigned long long length = (f2.functionType == STRING_FUNCTION) ? f2.stringValue.size() : f2.literalFunctions.size();
+			if (f1.numberValue.integerValue < 0 || (unsigned long long)f1.numberValue.integerValue > length) {
 				runtime_die("Out of bounds error on the number passed to `split`.");
 			}
 			if (f2.functionType == LIST_FUNCTION) {
 				lowOut.functionType = LIST_FUNCTION;
-				lowOut.literalFunctions.assign(f2.literalFunctions.begin(), f2.literalFunctions.begin() + f1.numberValue.integerValue);
+				lowOut.literalFunctions.assign(f2.literalFunctions.cbegin(), f2.literalFunctions.cbegin() + f1.numberValue.integerValue);
 				highOut.functionType = LIST_FUNCTION;
-				highOut.literalFunctions.assign(f2.literalFunctions.begin() + f1.numberValue.integerValue, f2.literalFunctions.end());
+				highOut.literalFunctions.assign(f2.literalFunctions.cbegin() + f1.numberValue.integerValue, f2.literalFunctions.cend());
 			} else if (f2.functionType == STRING_FUNCTION) {
 				lowOut.functionType = STRING_FUNCTION;
-				lowOut.stringValue.assign(f2.stringValue.begin(), f2.stringValue.begin() + f1.numberValue.integerValue);
+				lowOut.stringValue = f2.stringValue.substr(0, f1.numberValue.integerValue);
 				highOut.functionType = STRING_FUNCTION;
-				highOut.stringValue.assign(f2.stringValue.begin() + f1.numberValue.integerValue, f2.stringValue.end());
+				highOut.stringValue = f2.stringValue.substr(f1.numberValue.integerValue);
 			} else {
 				runtime_die("Non list/string passed to `split`.");
 			}
 		} else {
 			runtime_die("Non integer passed to `split`.");
 		}
-		r->getCurrentStack()->push(lowOut);
-		r->getCurrentStack()->push(highOut);
+		f2 = std::move(lowOut);
+		r->getCurrentStack()->push(std::move(highOut));
 	});
 	/*************************************
 	STRING MANIPULATION
 	*************************************/
 	addBuiltinFunction("tostring", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction out;
-		out.functionType = STRING_FUNCTION;
-		out.stringValue = charmFunctionToString(f1);
-		r->getCurrentStack()->push(out);
+		CharmFunction& f1 = r->getCurrentStack()->top();
+		CharmString text = charmFunctionToString(f1);
+		f1 = CharmFunction();
+		f1.functionType = STRING_FUNCTION;
+		f1.stringValue = std::move(text);
 	});
 	addBuiltinFunction("char", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
+		CharmFunction& f1 = r->getCurrentStack()->top();
 		if (f1.functionType == NUMBER_FUNCTION) {
 			if (f1.numberValue.whichType == INTEGER_VALUE) {
 				if (f1.numberValue.integerValue < 0) {
 					runtime_die("Negative integer passed to `char`.");
 				} else {
-					CharmFunction out;
-					out.functionType = STRING_FUNCTION;
-					out.stringValue = std::string(1, static_cast<char>(f1.numberValue.integerValue));
-					r->getCurrentStack()->push(out);
+					char c = static_cast<char>(f1.numberValue.integerValue);
+					f1 = CharmFunction();
+					f1.functionType = STRING_FUNCTION;
+					f1.stringValue = CharmString::character(c);
 				}
 			} else {
 				runtime_die("Non integer passed to `char`.");
@@ -305,16 +548,10 @@ PredefinedFunctions::PredefinedFunctions() {
 		}
 	});
 	addBuiltinFunction("ord", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
+		CharmFunction& f1 = r->getCurrentStack()->top();
 		if (f1.functionType == STRING_FUNCTION) {
 			if (f1.stringValue.size() > 0) {
-				CharmFunction out;
-				CharmNumber n;
-				n.whichType = INTEGER_VALUE;
-				n.integerValue = static_cast<long long>(f1.stringValue[0]);
-				out.functionType = NUMBER_FUNCTION;
-				out.numberValue = n;
-				r->getCurrentStack()->push(out);
+				f1 = Stack::intF(static_cast<long long>(f1.stringValue[0]));
 			} else {
 				runtime_die("Empty string passed to `ord`.");
 			}
@@ -322,10 +559,242 @@ PredefinedFunctions::PredefinedFunctions() {
 			runtime_die("Non string passed to `ord`.");
 		}
 	});
+	//these search the string a piece at a time (see CharmString::find) instead of flattening it,
+	//and what they push shares the bytes of what they were given. (the patterns they're given
+	//have been popped, so flattening those doesn't change anything the script can see)
+	addBuiltinFunction("find", [](Runner* r) {
+		//what to look for
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//what to look in, which stays where it is
+		const CharmFunction& f2 = r->getCurrentStack()->top();
+		if (f1.functionType != STRING_FUNCTION || f2.functionType != STRING_FUNCTION) {
+			runtime_die("Non string passed to `find`.");
+		}
+		size_t found = f2.stringValue.find(f1.stringValue.str());
+		r->getCurrentStack()->push(Stack::intF((found == std::string::npos) ? -1 : (long long)found));
+	});
+	addBuiltinFunction("substring", [](Runner* r) {
+		//end index (not included)
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//start index
+		CharmFunction f2 = r->getCurrentStack()->pop();
+		//string, which stays where it is
+		const CharmFunction& f3 = r->getCurrentStack()->top();
+		if (!Stack::isInt(f1) || !Stack::isInt(f2)) {
+			runtime_die("Non integer index passed to `substring`.");
+		}
+		if (f3.functionType != STRING_FUNCTION) {
+			runtime_die("Non string passed to `substring`.");
+		}
+		long long from = f2.numberValue.integerValue;
+		long long to = f1.numberValue.integerValue;
+		if (from < 0 || (unsigned long long)to > f3.stringValue.size()) {
+			runtime_die("Out of bounds error on the numbers passed to `substring`.");
+		}
+		CharmFunction out;
+		out.functionType = STRING_FUNCTION;
+		if (from < to) {
+			out.stringValue = f3.stringValue.substr(from, to - from);
+		}
+		r->getCurrentStack()->push(std::move(out));
+	});
+	addBuiltinFunction("replace", [](Runner* r) {
+		//what to replace it with
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//what to replace
+		CharmFunction f2 = r->getCurrentStack()->pop();
+		//the string to replace it in (and then the string it's replaced with)
+		CharmFunction& f3 = r->getCurrentStack()->top();
+		if (f1.functionType != STRING_FUNCTION || f2.functionType != STRING_FUNCTION || f3.functionType != STRING_FUNCTION) {
+			runtime_die("Non string passed to `replace`.");
+		}
+		if (f2.stringValue.empty()) {
+			runtime_die("Empty string passed to `replace`.");
+		}
+		const std::string& pattern = f2.stringValue.str();
+		CharmFunction out;
+		out.functionType = STRING_FUNCTION;
+		size_t done = 0;
+		size_t at;
+		while ((at = f3.stringValue.find(pattern, done)) != std::string::npos) {
+			out.stringValue.append(f3.stringValue.substr(done, at - done));
+			out.stringValue.append(f1.stringValue);
+			done = at + pattern.size();
+		}
+		out.stringValue.append(f3.stringValue.substr(done));
+		f3 = std::move(out);
+	});
+	addBuiltinFunction("splitby", [](Runner* r) {
+		//the delimiter
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//the string to split (and then the list of pieces)
+		CharmFunction& f2 = r->getCurrentStack()->top();
+		if (f1.functionType != STRING_FUNCTION || f2.functionType != STRING_FUNCTION) {
+			runtime_die("Non string passed to `splitby`.");
+		}
+		CharmFunction out;
+		out.functionType = LIST_FUNCTION;
+		CharmFunction piece;
+		piece.functionType = STRING_FUNCTION;
+		if (f1.stringValue.empty()) {
+			//an empty delimiter splits it into characters
+			for (size_t n = 0; n < f2.stringValue.size(); n++) {
+				piece.stringValue = CharmString::character(f2.stringValue[n]);
+				out.literalFunctions.push_back(piece);
+			}
+		} else {
+			const std::string& delimiter = f1.stringValue.str();
+			size_t done = 0;
+			size_t at;
+			while ((at = f2.stringValue.find(delimiter, done)) != std::string::npos) {
+				piece.stringValue = f2.stringValue.substr(done, at - done);
+				out.literalFunctions.push_back(piece);
+				done = at + delimiter.size();
+			}
+			piece.stringValue = f2.stringValue.substr(done);
+			out.literalFunctions.push_back(piece);
+		}
+		f2 = std::move(out);
+	});
+	addBuiltinFunction("join", [](Runner* r) {
+		//what goes between them
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//the list of strings (and then the string they're joined into)
+		CharmFunction& f2 = r->getCurrentStack()->top();
+		if (f1.functionType != STRING_FUNCTION) {
+			runtime_die("Non string separator passed to `join`.");
+		}
+		if (f2.functionType != LIST_FUNCTION) {
+			runtime_die("Non list passed to `join`.");
+		}
+		const CHARM_LIST_TYPE& strings = f2.literalFunctions;
+		CharmFunction out;
+		out.functionType = STRING_FUNCTION;
+		for (unsigned long long n = 0; n < strings.size(); n++) {
+			if (strings[n].functionType != STRING_FUNCTION) {
+				runtime_die("List with a non string in it passed to `join`.");
+			}
+			if (n > 0) {
+				out.stringValue.append(f1.stringValue);
+			}
+			out.stringValue.append(strings[n].stringValue);
+		}
+		f2 = std::move(out);
+	});
+	/*************************************
+	SORTING
+	*************************************/
+	addBuiltinFunction("sort", [](Runner* r) {
+		//the list to sort, which is sorted where it is
+		CharmFunction& f1 = r->getCurrentStack()->top();
+		if (f1.functionType != LIST_FUNCTION) {
+			runtime_die("Non list passed to `sort`.");
+		}
+		f1 = sortList(std::move(f1));
+	});
+	addBuiltinFunction("sortby", [](Runner* r, RunnerContext* context) {
+		//the comparator, which takes two values and pushes a positive int if the first goes after the second
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//the list to sort
+		CharmFunction f2 = r->getCurrentStack()->pop();
+		if (f1.functionType != LIST_FUNCTION || f2.functionType != LIST_FUNCTION) {
+			runtime_die("Non list passed to `sortby`.");
+		}
+		std::vector<CharmFunction*> order;
+		order.reserve(f2.literalFunctions.size());
+		for (CharmFunction& f : f2.literalFunctions) {
+			order.push_back(&f);
+		}
+		std::vector<SortbyLess> less = { { r, &f1.literalFunctions, context->fA } };
+		//a pure comparator only touches the stack it's run on, so big lists are sorted on more
+		//threads, each running it on its own worker copy of the runner (see Runner::worker)
+		std::vector<std::unique_ptr<Runner>> runners;
+		if (order.size() >= PARALLEL_SORT_SIZE && sortJobs() > 1 && context->fA->isPure(f1)) {
+			less.clear();
+			for (size_t n = 0; n < sortJobs(); n++) {
+				runners.push_back(r->worker());
+				less.push_back({ runners.back().get(), &f1.literalFunctions, context->fA });
+			}
+		}
+		mergeSort(order, less);
+		r->joinWorkers(runners);
+		CharmFunction out;
+		out.functionType = LIST_FUNCTION;
+		out.literalFunctions.reserve(order.size());
+		for (CharmFunction* f : order) {
+			out.literalFunctions.push_back(std::move(*f));
+		}
+		r->getCurrentStack()->push(std::move(out));
+	}, false);
+	/*************************************
+	MAPS
+	*************************************/
+	//the map stays on the stack, like a string or list does for len and at
+	addBuiltinFunction("mnew", [](Runner* r) {
+		CharmFunction& out = r->getCurrentStack()->emplace();
+		out.functionType = MAP_FUNCTION;
+		out.mapValue = std::make_shared<CharmMap>();
+	});
+	addBuiltinFunction("mget", [](Runner* r) {
+		//key
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//map
+		const CharmFunction& f2 = r->getCurrentStack()->top();
+		if (f2.functionType != MAP_FUNCTION) {
+			runtime_die("Non map passed to `mget`.");
+		}
+		auto found = f2.mapValue->entries.find(f1);
+		if (found == f2.mapValue->entries.end()) {
+			runtime_die("Missing key " + charmFunctionToString(f1, PREVIEW_LIMITS) + " passed to `mget`.");
+		}
+		r->getCurrentStack()->push(found->second);
+	});
+	addBuiltinFunction("mset", [](Runner* r) {
+		//value
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//key
+		CharmFunction f2 = r->getCurrentStack()->pop();
+		//map
+		CharmFunction& f3 = writableMap(r, "mset");
+		f3.mapValue->entries[std::move(f2)] = std::move(f1);
+	});
+	addBuiltinFunction("mhas", [](Runner* r) {
+		//key
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//map
+		const CharmFunction& f2 = r->getCurrentStack()->top();
+		if (f2.functionType != MAP_FUNCTION) {
+			runtime_die("Non map passed to `mhas`.");
+		}
+		r->getCurrentStack()->push(Stack::intF(f2.mapValue->entries.count(f1)));
+	});
+	addBuiltinFunction("mdel", [](Runner* r) {
+		//key
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		//map
+		CharmFunction& f2 = writableMap(r, "mdel");
+		f2.mapValue->entries.erase(f1);
+	});
+	addBuiltinFunction("mkeys", [](Runner* r) {
+		//map
+		const CharmFunction& f1 = r->getCurrentStack()->top();
+		if (f1.functionType != MAP_FUNCTION) {
+			runtime_die("Non map passed to `mkeys`.");
+		}
+		//(in no particular order)
+		CharmFunction out;
+		out.functionType = LIST_FUNCTION;
+		for (const auto& entry : f1.mapValue->entries) {
+			out.literalFunctions.push_back(entry.first);
+		}
+		r->getCurrentStack()->push(std::move(out));
+	});
 	/*************************************
 	CONTROL FLOW
 	*************************************/
 	addBuiltinFunction("i", [](Runner* r, RunnerContext* context) {
+		//(a list can run itself with `i`, so this counts towards the depth like a definition does)
+		Runner::CallFrame frame(r, nullptr);
 		//pop the top of the stack and run it
 		CharmFunction f1 = r->getCurrentStack()->pop();
 		if (f1.functionType == LIST_FUNCTION) {
@@ -334,13 +803,14 @@ PredefinedFunctions::PredefinedFunctions() {
 		} else {
 			runtime_die("Non list passed to `i`.");
 		}
-	});
+	}, false);
 	addBuiltinFunction("q", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
+		//(the value is moved into the list, which takes its place)
+		CharmFunction& f1 = r->getCurrentStack()->top();
 		CharmFunction list;
 		list.functionType = LIST_FUNCTION;
-		list.literalFunctions.push_back(f1);
-		r->getCurrentStack()->push(list);
+		list.literalFunctions.push_back(std::move(f1));
+		f1 = std::move(list);
 	});
 	addBuiltinFunction("ifthen", [](Runner* r, RunnerContext* context) {
 		//the arguments to this function are a little different...
@@ -353,18 +823,25 @@ PredefinedFunctions::PredefinedFunctions() {
 		//stack[2] = condition to run truthy section
 		//stack[1] = truthy section (if...)
 		//stack[0] = falsy section (else...)
+		//(and so can a list that's given to `ifthen` as its own condition or branch)
+		Runner::CallFrame frame(r, nullptr);
 		//have to reverse it because popping is weird
-		CharmFunction falsy = r->getCurrentStack()->pop();
+		//(they're kept here while they run, and never changed: a tail call is left off the end of the
+		//code that's run instead of being removed from the list, which would copy the list)
+		const CharmFunction falsy = r->getCurrentStack()->pop();
 		bool falsyTailCall = false;
-		CharmFunction truthy = r->getCurrentStack()->pop();
+		const CharmFunction truthy = r->getCurrentStack()->pop();
 		bool truthyTailCall = false;
-		CharmFunction condFunction = r->getCurrentStack()->pop();
+		const CharmFunction condFunction = r->getCurrentStack()->pop();
 		if ((condFunction.functionType == LIST_FUNCTION) &&
 			(truthy.functionType == LIST_FUNCTION) &&
 			(falsy.functionType == LIST_FUNCTION)) {
+				const CHARM_LIST_TYPE& condition = condFunction.literalFunctions;
+				const CharmFunction* truthyEnd = truthy.literalFunctions.cend();
+				const CharmFunction* falsyEnd = falsy.literalFunctions.cend();
 				//first, we run checks to set the tail call bools
 				if (context->fD != nullptr) {
-					std::string defName = context->fD->functionName;
+					const CharmSymbol& defName = context->fD->functionName;
 					if (truthy.literalFunctions.size() > 0 && truthy.literalFunctions.back().functionName == defName) {
 						truthyTailCall = true;
 					}
@@ -375,16 +852,17 @@ PredefinedFunctions::PredefinedFunctions() {
 					//there are 3 seperate cases here: truthy tail call, falsy tail call, or both
 					if (truthyTailCall) {
 						ONLYDEBUG printf("ENGAGING TRUTHY IF/THEN TAIL CALL OPTIMIZATION\n");
-						//remove the tail call
-						truthy.literalFunctions.pop_back();
+						//leave off the tail call
+						truthyEnd--;
 						while (1) {
-							r->runWithContext(condFunction.literalFunctions, context);
+							r->step();
+							r->runWithContext(condition, context);
 							CharmFunction cond = r->getCurrentStack()->pop();
 							if (Stack::isInt(cond)) {
 								if (cond.numberValue.integerValue > 0) {
-									r->runWithContext(truthy.literalFunctions, context);
+									r->runWithContext(truthy.literalFunctions.cbegin(), truthyEnd, context);
 								} else {
-									r->runWithContext(falsy.literalFunctions, context);
+									r->runWithContext(falsy.literalFunctions.cbegin(), falsyEnd, context);
 									//end this function immediately once the tail call loop ends
 									ONLYDEBUG printf("DISENGAGING TRUTHY IF/THEN TAIL CALL OPTIMIZATION\n");
 									return;
@@ -396,19 +874,20 @@ PredefinedFunctions::PredefinedFunctions() {
 					}
 					if (falsyTailCall) {
 						ONLYDEBUG printf("ENGAGING FALSY IF/THEN TAIL CALL OPTIMIZATION\n");
-						//remove the tail call
-						falsy.literalFunctions.pop_back();
+						//leave off the tail call
+						falsyEnd--;
 						while (1) {
-							r->runWithContext(condFunction.literalFunctions, context);
+							r->step();
+							r->runWithContext(condition, context);
 							CharmFunction cond = r->getCurrentStack()->pop();
 							if (Stack::isInt(cond)) {
 								if (cond.numberValue.integerValue > 0) {
-									r->runWithContext(truthy.literalFunctions, context);
+									r->runWithContext(truthy.literalFunctions.cbegin(), truthyEnd, context);
 									//end this function immediately once the tail call loop ends
 									ONLYDEBUG printf("DISENGAGING FALSY IF/THEN TAIL CALL OPTIMIZATION\n");
 									return;
 								} else {
-									r->runWithContext(falsy.literalFunctions, context);
+									r->runWithContext(falsy.literalFunctions.cbegin(), falsyEnd, context);
 								}
 							} else {
 								runtime_die("`ifthen` condition returned non integer.");
@@ -421,16 +900,17 @@ PredefinedFunctions::PredefinedFunctions() {
 					//so we run it as an infinite loop
 					if (truthyTailCall && falsyTailCall) {
 						ONLYDEBUG printf("ENGAGING TRUTHY/FALSY IF/THEN TAIL CALL OPTIMIZATION\n");
-						//remove the tail calls
-						truthy.literalFunctions.pop_back();
-						falsy.literalFunctions.pop_back();
+						//leave off the tail calls
+						truthyEnd--;
+						falsyEnd--;
 						while (1) {
+							r->step();
 							CharmFunction cond = r->getCurrentStack()->pop();
 							if (Stack::isInt(cond)) {
 								if (cond.numberValue.integerValue > 0) {
-									r->runWithContext(truthy.literalFunctions, context);
+									r->runWithContext(truthy.literalFunctions.cbegin(), truthyEnd, context);
 								} else {
-									r->runWithContext(falsy.literalFunctions, context);
+									r->runWithContext(falsy.literalFunctions.cbegin(), falsyEnd, context);
 								}
 							} else {
 								runtime_die("`ifthen` condition returned non integer.");
@@ -441,14 +921,14 @@ PredefinedFunctions::PredefinedFunctions() {
 					ONLYDEBUG printf("DISENGAGING TRUTHY/FALSY IF/THEN TAIL CALL OPTIMIZATION\n");
 				}
 				//but if not (or context was nullptr), continue execution as normal
-				r->runWithContext(condFunction.literalFunctions, context);
+				r->runWithContext(condition, context);
 				//now we check the top of the stack to see if it's truthy or falsy
 				CharmFunction cond = r->getCurrentStack()->pop();
 				if (Stack::isInt(cond)) {
 					if (cond.numberValue.integerValue > 0) {
-						r->runWithContext(truthy.literalFunctions, context);
+						r->runWithContext(truthy.literalFunctions.cbegin(), truthyEnd, context);
 					} else {
-						r->runWithContext(falsy.literalFunctions, context);
+						r->runWithContext(falsy.literalFunctions.cbegin(), falsyEnd, context);
 					}
 				} else {
 					runtime_die("`ifthen` condition returned non integer.");
@@ -463,7 +943,7 @@ PredefinedFunctions::PredefinedFunctions() {
 		if (f1.functionType == LIST_FUNCTION) {
 			CharmFunction out;
 			out.functionType = LIST_FUNCTION;
-			for (CharmFunction f : f1.literalFunctions) {
+			for (const CharmFunction& f : std::as_const(f1.literalFunctions)) {
 				if (f.functionType == DEFINED_FUNCTION) {
 					if (!context->fA->doInline(out.literalFunctions, f)) {
 						out.literalFunctions.push_back(f);
@@ -472,27 +952,24 @@ PredefinedFunctions::PredefinedFunctions() {
 					out.literalFunctions.push_back(f);
 				}
 			}
-			r->getCurrentStack()->push(out);
+			//superinstructions that came in with the definitions are expanded back out,
+			//so that what you see is still what the definitions say
+			Superinstructions::expand(out.literalFunctions);
+			r->getCurrentStack()->push(std::move(out));
 		} else {
 			runtime_die("Non list passed to `inline`.");
 		}
-	});
+	}, false);
 	/*************************************
 	BOOLEAN OPS
 	*************************************/
 	addBuiltinFunction("xor", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction f2 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1) && Stack::isInt(f2)) {
-			CharmFunction out;
-			out.functionType = NUMBER_FUNCTION;
-			CharmNumber outNum;
-			outNum.whichType = INTEGER_VALUE;
 			//cancer incoming
-			outNum.integerValue = ((f1.numberValue.integerValue > 0) ^ (f2.numberValue.integerValue > 0));
+			f2.numberValue.integerValue = ((f1.numberValue.integerValue > 0) ^ (f2.numberValue.integerValue > 0));
 			//no more cancer
-			out.numberValue = outNum;
-			r->getCurrentStack()->push(out);
 		} else {
 			runtime_die("Non integer passed to logic function.");
 		}
@@ -501,9 +978,9 @@ PredefinedFunctions::PredefinedFunctions() {
 	TYPE INSPECIFIC MATH
 	*************************************/
 	addBuiltinFunction("abs", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
+		CharmFunction& f1 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1)) {
-			std::abs(f1.numberValue.integerValue);
+			f1.numberValue.integerValue = std::abs(f1.numberValue.integerValue);
 		} else if (Stack::isFloat(f1)) {
 			if (f1.numberValue.floatValue < 0) {
 				f1.numberValue.floatValue = -f1.numberValue.floatValue;
@@ -517,57 +994,77 @@ PredefinedFunctions::PredefinedFunctions() {
 	*************************************/
 	addBuiltinFunction("+", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction f2 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1) && Stack::isInt(f2)) {
-			f1.numberValue.integerValue = f1.numberValue.integerValue + f2.numberValue.integerValue;
+			f2.numberValue.integerValue = f1.numberValue.integerValue + f2.numberValue.integerValue;
 		} else {
 			runtime_die("Non integer passed to `+`.");
 		}
-		r->getCurrentStack()->push(f1);
 	});
 	addBuiltinFunction("-", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction f2 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1) && Stack::isInt(f2)) {
-			f1.numberValue.integerValue = f2.numberValue.integerValue - f1.numberValue.integerValue;
+			f2.numberValue.integerValue = f2.numberValue.integerValue - f1.numberValue.integerValue;
 		} else {
 			runtime_die("Non integer passed to `-`.");
 		}
-		r->getCurrentStack()->push(f1);
 	});
 	addBuiltinFunction("/", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction f2 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1) && Stack::isInt(f2)) {
-			//f1 used as answer
-			f1.numberValue.integerValue = f2.numberValue.integerValue / f1.numberValue.integerValue;
+			//(both of these would crash the whole program, not just the script)
+			if (f1.numberValue.integerValue == 0) {
+				runtime_die("Division by zero in `/`.");
+			}
+			if (f1.numberValue.integerValue == -1 && f2.numberValue.integerValue == std::numeric_limits<long long>::min()) {
+				runtime_die("Overflow in `/`.");
+			}
+			long long quotient = f2.numberValue.integerValue / f1.numberValue.integerValue;
 			//f2 used as modulus
 			f2.numberValue.integerValue = f2.numberValue.integerValue % f1.numberValue.integerValue;
+			//f1 used as answer
+			f1.numberValue.integerValue = quotient;
 		} else {
-			runtime_die("Non integer passed to `+`.");
+			runtime_die("Non integer passed to `/`.");
 		}
-		r->getCurrentStack()->push(f2);
-		r->getCurrentStack()->push(f1);
+		r->getCurrentStack()->push(std::move(f1));
 	});
 	addBuiltinFunction("*", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
-		CharmFunction f2 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
 		if (Stack::isInt(f1) && Stack::isInt(f2)) {
-			f1.numberValue.integerValue = f1.numberValue.integerValue * f2.numberValue.integerValue;
+			f2.numberValue.integerValue = f1.numberValue.integerValue * f2.numberValue.integerValue;
 		} else {
 			runtime_die("Non integer passed to `*`.");
 		}
-		r->getCurrentStack()->push(f1);
 	});
-	addBuiltinFunction("toint", [](Runner* r) {
+	//these skip the checks, and are only used where TypeInference.cpp proved the arguments are ints
+	addBuiltinFunction("%+", [](Runner* r) {
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
+		f2.numberValue.integerValue = f1.numberValue.integerValue + f2.numberValue.integerValue;
+	});
+	addBuiltinFunction("%-", [](Runner* r) {
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
+		f2.numberValue.integerValue = f2.numberValue.integerValue - f1.numberValue.integerValue;
+	});
+	addBuiltinFunction("%*", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
+		CharmFunction& f2 = r->getCurrentStack()->top();
+		f2.numberValue.integerValue = f1.numberValue.integerValue * f2.numberValue.integerValue;
+	});
+	addBuiltinFunction("toint", [](Runner* r) {
+		CharmFunction& f1 = r->getCurrentStack()->top();
 		if (Stack::isFloat(f1)) {
 			f1.numberValue.whichType = INTEGER_VALUE;
 			f1.numberValue.integerValue = (long long)f1.numberValue.floatValue;
 		} else if (Stack::isInt(f1)) {
 			//do nothing, it's already an int
 		} else {
-			runtime_die("Non number passed to `toInt`.");
+			runtime_die("Non number passed to `toint`.");
 		}
 	});
 	/*************************************
@@ -587,27 +1084,78 @@ PredefinedFunctions::PredefinedFunctions() {
 		} else {
 			runtime_die("Non integer passed to `createStack`.");
 		}
-	});
+	}, false);
 	addBuiltinFunction("getstack", [](Runner* r) {
 		//name of the stack
 		r->getCurrentStack()->push(r->getCurrentStack()->name);
-	});
+	}, false);
 	addBuiltinFunction("switchstack", [](Runner* r) {
 		CharmFunction f1 = r->getCurrentStack()->pop();
 		r->switchCurrentStack(f1);
-	});
+	}, false);
 	/*************************************
 	REF GETTING/SETTING
 	*************************************/
 	addBuiltinFunction("getref", [](Runner* r) {
-		CharmFunction f1 = r->getCurrentStack()->pop();
-		r->getCurrentStack()->push(r->getReference(f1));
-	});
+		CharmFunction& f1 = r->getCurrentStack()->top();
+		f1 = r->getReference(f1);
+	}, false);
 	addBuiltinFunction("setref", [](Runner* r) {
 		//the value of the reference
 		CharmFunction f1 = r->getCurrentStack()->pop();
 		//the name of the reference
 		CharmFunction f2 = r->getCurrentStack()->pop();
-		r->setReference(f2, f1);
+		r->setReference(std::move(f2), std::move(f1));
+	}, false);
+	/*************************************
+	SUPERINSTRUCTIONS
+	(Superinstructions.cpp has the sequences these replace)
+	*************************************/
+	addBuiltinFunction("%flip", [](Runner* r) {
+		//0 1 swap
+		r->getCurrentStack()->swap(0, 1);
+	});
+	addBuiltinFunction("%swapnth", [](Runner* r) {
+		//dup 1 + swap
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		if (!Stack::isInt(f1)) {
+			runtime_die("Non integer passed to `+`.");
+		}
+		if (f1.numberValue.integerValue < 0) {
+			runtime_die("Negative int passed to `swap`.");
+		}
+		if (f1.numberValue.integerValue + 1 >= r->MAX_STACK) {
+			runtime_die("Overflowing pointers passed to `swap`.");
+		}
+		r->getCurrentStack()->swap((unsigned long long)f1.numberValue.integerValue + 1, (unsigned long long)f1.numberValue.integerValue);
+	});
+	addBuiltinFunction("%copyfrom", copyFrom, false);
+	addBuiltinFunction("%dupcopyfrom", [](Runner* r) {
+		//dup <n> copyfrom
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		Stack* stack = r->getCurrentStack();
+		stack->push(stack->at(0));
+		stack->push(f1);
+		copyFrom(r);
+	}, false);
+	addBuiltinFunction("%addunder", [](Runner* r) {
+		//flip <n> + flip
+		CharmFunction f1 = r->getCurrentStack()->pop();
+		Stack* stack = r->getCurrentStack();
+		CharmFunction& under = stack->peek(1);
+		if (Stack::isInt(f1) && Stack::isInt(under)) {
+			under.numberValue.integerValue = f1.numberValue.integerValue + under.numberValue.integerValue;
+		} else {
+			runtime_die("Non integer passed to `+`.");
+		}
+	});
+	addBuiltinFunction("%swap12concat", [](Runner* r) {
+		//1 2 swap concat
+		r->getCurrentStack()->swap(1, 2);
+		concat(r);
 	});
+	addBuiltinFunction("%put", [](Runner* r) {
+		//dup p newline
+		outputValue(r, r->getCurrentStack()->at(0), true);
+	}, false);
 }
@@ -6,6 +6,7 @@
 #include <functional>
 
 #include "ParserTypes.h"
+#include "CompletionIndex.h"
 
 
 //In Runner.h
@@ -15,6 +16,8 @@ class FunctionDefinition;
 struct BuiltinFunction {
 	std::variant<std::function<void(Runner*)>, std::function<void(Runner*, RunnerContext*)>> f;
 	bool takesContext;
+	//pure functions only touch the current stack: no I/O, refs, stacks or definitions
+	bool pure;
 };
 
 class PredefinedFunctions {
@@ -24,9 +27,16 @@ private:
 	//b) an int
 	static bool isInt(CharmFunction f);
 public:
-	std::unordered_map<std::string, BuiltinFunction> cppFunctionNames;
+	std::unordered_map<CharmSymbol, BuiltinFunction> cppFunctionNames;
+	//and their names, for tab completion
+	CompletionIndex builtinNames;
 	PredefinedFunctions();
-	void functionLookup(std::string functionName, Runner* r, RunnerContext* context);
-	void addBuiltinFunction(std::string n, std::function<void(Runner*, RunnerContext*)> f);
-	void addBuiltinFunction(std::string n, std::function<void(Runner*)> f);
+	void functionLookup(CharmSymbol functionName, Runner* r, RunnerContext* context);
+	static void run(const BuiltinFunction& f, Runner* r, RunnerContext* context);
+	void addBuiltinFunction(std::string n, std::function<void(Runner*, RunnerContext*)> f, bool pure = true);
+	void addBuiltinFunction(std::string n, std::function<void(Runner*)> f, bool pure = true);
+	bool isBuiltinFunction(CharmSymbol n);
+	bool isPureBuiltinFunction(CharmSymbol n);
+	//how many threads sort and sortby use on big lists. 0 (the default) means one per core
+	static void setSortJobs(unsigned int jobs);
 };
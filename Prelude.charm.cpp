@@ -84,16 +84,11 @@ succ := 1 +
 " STRING MANIPULATION " pop
 " =================== " pop
 
+" find, substring, replace, splitby and join are builtins " pop
+
 " space " pop
 space := 32 char
 
-" [ list ] <from> <to> substring " pop
-_substring_args     := " " 3 pushto
-_substring_distance := dup 2 copyfrom - 1 -
-_substring_iter     := 0 2 swap 1 copyfrom at 1 4 swap concat 0 3 swap 0 2 swap flip succ flip
-_substring          := [ _substring_distance succ ] [ _substring_iter _substring ] [ pop pop flip ] ifthen
-substring           := _substring_args _substring
-
 " LIST MANIPULATION " pop
 " ================= " pop
 
@@ -0,0 +1,83 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "Profiler.h"
+#include "ParserTypes.h"
+#include "Error.h"
+
+void Profiler::recordFunction(Window& window, const CharmFunction& f, bool fusable) {
+	if (!fusable) {
+		window.functions.clear();
+		return;
+	}
+	window.functions.push_back(charmFunctionToString(f));
+	if (window.functions.size() > MAX_SEQUENCE) {
+		window.functions.erase(window.functions.begin());
+	}
+	//count every sequence that ends with this function
+	std::string sequence = window.functions.back();
+	for (auto fIter = std::next(window.functions.rbegin()); fIter != window.functions.rend(); fIter++) {
+		sequence = *fIter + " " + sequence;
+		sequenceCounts[sequence]++;
+	}
+}
+
+void Profiler::recordCall(const std::string& fName) {
+	callCounts[fName]++;
+}
+
+std::vector<std::pair<std::string, unsigned long long>> Profiler::topSequences(unsigned long long n) {
+	std::vector<std::pair<std::string, unsigned long long>> out(sequenceCounts.begin(), sequenceCounts.end());
+	std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+		//most run first, then longest first (it saves more dispatches)
+		if (a.second != b.second) return a.second > b.second;
+		return a.first.size() > b.first.size();
+	});
+	if (out.size() > n) {
+		out.resize(n);
+	}
+	return out;
+}
+
+void Profiler::writeProfile(std::string path) {
+	std::ofstream profileFile(path);
+	if (!profileFile) {
+		runtime_die("Couldn't open " + path + " to write the profile.");
+	}
+	profileFile << "# charm profile: <kind> <count> <functions>" << std::endl;
+	for (const auto& sequence : topSequences(sequenceCounts.size())) {
+		profileFile << "sequence " << sequence.second << " " << sequence.first << std::endl;
+	}
+	std::vector<std::pair<std::string, unsigned long long>> calls(callCounts.begin(), callCounts.end());
+	std::sort(calls.begin(), calls.end(), [](const auto& a, const auto& b) {
+		if (a.second != b.second) return a.second > b.second;
+		return a.first < b.first;
+	});
+	for (const auto& call : calls) {
+		profileFile << "call " << call.second << " " << call.first << std::endl;
+	}
+}
+
+std::unordered_map<std::string, unsigned long long> Profiler::readCallCounts(std::string path) {
+	std::ifstream profileFile(path);
+	if (!profileFile) {
+		runtime_die("Couldn't open " + path + " to read the profile.");
+	}
+	std::unordered_map<std::string, unsigned long long> out;
+	std::string line;
+	while (std::getline(profileFile, line)) {
+		//only the call lines matter here, skip the comments and sequences
+		std::stringstream lineS(line);
+		std::string kind, fName;
+		unsigned long long count;
+		if (!(lineS >> kind) || kind != "call") {
+			continue;
+		}
+		if (!(lineS >> count >> fName)) {
+			runtime_die("Malformed line in the profile " + path + ": " + line);
+		}
+		out[fName] += count;
+	}
+	return out;
+}
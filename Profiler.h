@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "ParserTypes.h"
+
+//counts which sequences of functions get run the most, to find
+//candidates for new superinstructions (see Superinstructions.cpp),
+//and which defined functions get called the most, for the inliner
+class Profiler {
+private:
+	std::unordered_map<std::string, unsigned long long> sequenceCounts;
+	std::unordered_map<std::string, unsigned long long> callCounts;
+public:
+	//the longest sequence that gets counted
+	static const unsigned int MAX_SEQUENCE = 4;
+	//the last few functions run from a single list (a vector, since one of these is made
+	//for every list that's run, and an empty one doesn't allocate anything)
+	struct Window {
+		std::vector<std::string> functions;
+	};
+	//only literals and builtins can be fused, anything else (fusable = false) breaks up the window
+	void recordFunction(Window& window, const CharmFunction& f, bool fusable);
+	//the n most run sequences, most run first
+	std::vector<std::pair<std::string, unsigned long long>> topSequences(unsigned long long n);
+	//calls to functions defined in Charm (inlined ones don't get called, so they aren't counted)
+	void recordCall(const std::string& fName);
+	void writeProfile(std::string path);
+	//the call counts from a profile written by writeProfile
+	static std::unordered_map<std::string, unsigned long long> readCallCounts(std::string path);
+};
@@ -1,10 +1,16 @@
 #include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>
+#include <utility>
 
 #include "Runner.h"
 #include "ParserTypes.h"
 #include "PredefinedFunctions.h"
+#include "TypeInference.h"
 #include "Error.h"
 #include "Debug.h"
+#include "CharmPool.h"
 
 void Runner::addFunctionDefinition(FunctionDefinition fD) {
 	//first, check and make sure there's no other definition with
@@ -18,6 +24,7 @@ void Runner::addFunctionDefinition(FunctionDefinition fD) {
 		}
 	}
 	if (!functionExists) {
+		definitionNames.insert(fD.functionName);
 		functionDefinitions.push_back(fD);
 	}
 }
@@ -27,11 +34,133 @@ Runner::Runner() {
 	CharmFunction zero = Stack::zeroF();
 	currentStackName = zero;
 	stacks.push_back(Stack(MAX_STACK, zero));
-	pF = new PredefinedFunctions();
+	pF = std::make_shared<PredefinedFunctions>();
+	profiler = nullptr;
+	depth = 0;
+	cancelledBy = nullptr;
+	setLimits(ExecutionLimits());
+}
+
+ExecutionLimitError::ExecutionLimitError(std::string message, std::vector<std::string> callChain)
+	: std::runtime_error(message), callChain(callChain) {}
+
+void Runner::setLimits(ExecutionLimits newLimits) {
+	limits = newLimits;
+	steps = 0;
+	nextCheck = 0;
+	memoryBaselineTaken = false;
+	deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(limits.timeoutMilliseconds);
+	cancelled.value.store(false);
+}
+
+void Runner::cancel() {
+	cancelled.value.store(true);
+}
+
+unsigned long long Runner::getSteps() {
+	return steps;
+}
+
+std::unique_ptr<Runner> Runner::worker() {
+	std::unique_ptr<Runner> w(new Runner(*this));
+	w->getCurrentStack()->stack.clear();
+	w->profiler = nullptr;
+	w->progress = nullptr;
+	w->cancelledBy = (cancelledBy != nullptr) ? cancelledBy : &cancelled.value;
+	//(it counts memory on its own thread, from its first check)
+	w->memoryBaselineTaken = false;
+	w->nextCheck = 0;
+	return w;
+}
+
+void Runner::joinWorkers(const std::vector<std::unique_ptr<Runner>>& workers) {
+	//they started counting from this runner's steps, which haven't changed while they ran
+	unsigned long long start = steps;
+	for (const std::unique_ptr<Runner>& w : workers) {
+		steps += w->steps - start;
+	}
+}
+
+void Runner::checkLimits() {
+	//(the first check is on the thread that's running, whichever one called setLimits)
+	if (!memoryBaselineTaken) {
+		memoryBaseline = CharmPool::threadBytesInUse();
+		memoryBaselineTaken = true;
+	}
+	if (limits.maxSteps > 0 && steps > limits.maxSteps) {
+		Runner::limitExceeded("Ran for more than the limit of " + std::to_string(limits.maxSteps) + " steps.");
+	}
+	if (limits.maxMemory > 0 && CharmPool::threadBytesInUse() - memoryBaseline > (long long)limits.maxMemory) {
+		Runner::limitExceeded("Used more than the limit of " + std::to_string(limits.maxMemory) + " bytes of memory.");
+	}
+	if (cancelled.value.load() || (cancelledBy != nullptr && cancelledBy->load())) {
+		Runner::limitExceeded("Cancelled.");
+	}
+	if (limits.timeoutMilliseconds > 0 && std::chrono::steady_clock::now() >= deadline) {
+		Runner::limitExceeded("Ran for more than the limit of " + std::to_string(limits.timeoutMilliseconds) + " milliseconds.");
+	}
+	if (progress) {
+		progress(this);
+	}
+	nextCheck = steps + LIMIT_CHECK_INTERVAL;
+	if (limits.maxSteps > 0) {
+		nextCheck = std::min(nextCheck, limits.maxSteps + 1);
+	}
+}
+
+ExecutionLimitError Runner::limitError(std::string message) {
+	std::vector<std::string> chain;
+	for (const std::string* functionName : callChain) {
+		chain.push_back(*functionName);
+	}
+	if (chain.size() > 0) {
+		message += " In ";
+		for (unsigned long long n = 0; n < chain.size(); n++) {
+			//(recursion repeats a name a lot, so a run of the same name is only written once)
+			unsigned long long repeats = 1;
+			while (n + 1 < chain.size() && chain[n + 1] == chain[n]) {
+				repeats++;
+				n++;
+			}
+			message += (message.back() == ' ' ? "`" : " > `") + chain[n] + "`";
+			if (repeats > 1) {
+				message += " (" + std::to_string(repeats) + " times)";
+			}
+		}
+		message += ".";
+	}
+	return ExecutionLimitError(message, chain);
+}
+
+void Runner::limitExceeded(std::string message) {
+	//(the call frames pop themselves off as this unwinds)
+	throw Runner::limitError(message);
+}
+
+void Runner::depthExceeded(bool named) {
+	//(made before the frame is undone, so that it names the definition that went too deep)
+	ExecutionLimitError error = Runner::limitError("Ran more than the limit of " + std::to_string(limits.maxDepth) + " calls deep.");
+	depth--;
+	if (named) {
+		callChain.pop_back();
+	}
+	throw error;
+}
+
+void Runner::push(const CharmFunction& f) {
+	Runner::getCurrentStack()->push(f);
+}
+
+void Runner::push(CharmFunction&& f) {
+	Runner::getCurrentStack()->push(std::move(f));
+}
+
+CharmFunction Runner::pop() {
+	return Runner::getCurrentStack()->pop();
 }
 
 bool Runner::doesStackExist(CharmFunction name) {
-	for (Stack stack : stacks) {
+	for (Stack& stack : stacks) {
 		if (stack.isNameEqualTo(name)) {
 			return true;
 		}
@@ -63,8 +192,8 @@ void Runner::createStack(unsigned long long length, CharmFunction name) {
 	}
 }
 
-CharmFunction Runner::getReference(CharmFunction key) {
-	for (Reference r : references) {
+CharmFunction Runner::getReference(const CharmFunction& key) {
+	for (const Reference& r : references) {
 		if (r.key == key) {
 			return r.value;
 		}
@@ -73,25 +202,94 @@ CharmFunction Runner::getReference(CharmFunction key) {
 }
 
 void Runner::setReference(CharmFunction key, CharmFunction value) {
-	Reference newRef;
-	newRef.key = key;
-	newRef.value = value;
 	for (unsigned long long n = 0; n < references.size(); n++) {
 		if (references[n].key == key) {
 			//if the ref was previously defined
-			references[n] = newRef;
+			references[n].value = std::move(value);
 			return;
 		}
 	}
 	//if it wasn't previously defined then
-	references.push_back(newRef);
+	Reference newRef;
+	newRef.key = std::move(key);
+	newRef.value = std::move(value);
+	references.push_back(std::move(newRef));
 }
 
 std::vector<FunctionDefinition> Runner::getFunctionDefinitions() {
-	return Runner::functionDefinitions;
+	std::vector<FunctionDefinition> out = Runner::functionDefinitions;
+	if (frozenDefinitions != nullptr) {
+		for (const auto& frozen : *frozenDefinitions) {
+			if (Runner::findDefinition(frozen.first) == &frozen.second) {
+				out.push_back(frozen.second);
+			}
+		}
+	}
+	return out;
+}
+
+const FunctionDefinition* Runner::findDefinition(const CharmSymbol& functionName) {
+	for (const FunctionDefinition& fD : functionDefinitions) {
+		if (fD.functionName == functionName) {
+			return &fD;
+		}
+	}
+	if (frozenDefinitions != nullptr) {
+		auto frozen = frozenDefinitions->find(functionName);
+		if (frozen != frozenDefinitions->end()) {
+			return &frozen->second;
+		}
+	}
+	return nullptr;
+}
+
+//flattening a string changes it, so the ones in frozen definitions are flattened
+//before any other thread can see them (see CharmString)
+static void flattenStrings(CHARM_LIST_TYPE& body) {
+	for (CharmFunction& f : body) {
+		f.stringValue.flatten();
+		flattenStrings(f.literalFunctions);
+	}
+}
+
+void Runner::freezeDefinitions() {
+	auto frozen = std::make_shared<std::unordered_map<CharmSymbol, FunctionDefinition>>();
+	if (frozenDefinitions != nullptr) {
+		*frozen = *frozenDefinitions;
+	}
+	for (FunctionDefinition& fD : functionDefinitions) {
+		flattenStrings(fD.functionBody);
+		(*frozen)[fD.functionName] = fD;
+	}
+	frozenDefinitions = frozen;
+
+	auto frozenNames = std::make_shared<CompletionIndex>();
+	if (frozenDefinitionNames != nullptr) {
+		*frozenNames = *frozenDefinitionNames;
+	}
+	for (const FunctionDefinition& fD : functionDefinitions) {
+		frozenNames->insert(fD.functionName);
+	}
+	frozenDefinitionNames = frozenNames;
+	definitionNames = CompletionIndex();
+	functionDefinitions.clear();
+}
+
+std::vector<std::string> Runner::completeName(const std::string& prefix) {
+	//each of the three is sorted already, so they're just merged (a name can be in more than one)
+	std::vector<std::string> builtins, defined, frozen;
+	pF->builtinNames.complete(prefix, builtins);
+	definitionNames.complete(prefix, defined);
+	if (frozenDefinitionNames != nullptr) {
+		frozenDefinitionNames->complete(prefix, frozen);
+	}
+	std::vector<std::string> merged, out;
+	std::set_union(builtins.begin(), builtins.end(), defined.begin(), defined.end(), std::back_inserter(merged));
+	std::set_union(merged.begin(), merged.end(), frozen.begin(), frozen.end(), std::back_inserter(out));
+	return out;
 }
 
-void Runner::handleDefinedFunctions(CharmFunction f, RunnerContext* context) {
+void Runner::handleDefinedFunctions(const CharmFunction& f, RunnerContext* context) {
 	//PredefinedFunctions.h holds all the functions written in C++
 	//other than that, if these functions aren't built in, they are run through
 	//the functionDefinitions table.
@@ -99,44 +297,123 @@ void Runner::handleDefinedFunctions(CharmFunction f, RunnerContext* context) {
 	//first, make sure that the function we're trying to run exists in the PredefinedFunctions
 	//table. if it doesn't - assume it's defined in Charm and run through the
 	//functionDefinitions table.
-	bool isPredefinedFunction = (pF->cppFunctionNames.find(f.functionName) != pF->cppFunctionNames.end());
-	if (isPredefinedFunction) {
+	auto predefined = pF->cppFunctionNames.find(f.functionName);
+	if (predefined != pF->cppFunctionNames.end()) {
 		//run the predefined function!
 		//(note: the function context AKA the definition we are running code from
 		//is passed in for tail call optimization in PredefinedFunctions.cpp::ifthen())
-		pF->functionLookup(f.functionName, this, context);
+		pF->run(predefined->second, this, context);
 	} else {
 		//alright, now we get down and dirty
-		//look through the functionDefinitions table for a function with
-		//a matching name, and run that. if there are no functions - throw
-		//an error.
-		bool functionFound = false;
-		for (FunctionDefinition fD : functionDefinitions) {
-			if (fD.functionName == f.functionName) {
-				functionFound = true;
-				//wait! before we run it, check and make sure this function isn't tail recursive
-				if (fD.definitionInfo.tailCallRecursive) {
-					//if it is, drop the last call to itself and just run it in a loop
-					//TODO: exiting a tail-call loop?
-					CHARM_LIST_TYPE functionBodyCopy = fD.functionBody;
-					functionBodyCopy.pop_back();
-					while (1) {
-						Runner::run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>(functionBodyCopy, context->fA));
-					}
+		//look through the functionDefinitions table (and then the frozen
+		//definitions) for a function with a matching name, and run that.
+		//if there are no functions - throw an error.
+		const FunctionDefinition* found = Runner::findDefinition(f.functionName);
+		if (found != nullptr) {
+			if (profiler != nullptr) {
+				profiler->recordCall(f.functionName);
+			}
+			//compiled definitions do their own checks and tail calls
+			if (found->native != nullptr) {
+				found->native(this, context);
+				return;
+			}
+			CallFrame frame(this, &f.functionName.str());
+			//copy it out, running the body can change the table (the body isn't copied, just shared)
+			FunctionDefinition fD = *found;
+			//specialized definitions skip type checks that their signature proves, so it has to hold
+			if (fD.definitionInfo.checkedPopsCount > 0) {
+				Runner::checkArguments(fD);
+			}
+			//wait! before we run it, check and make sure this function isn't tail recursive
+			if (fD.definitionInfo.tailCallRecursive) {
+				//if it is, leave off the last call to itself and just run it in a loop
+				//TODO: exiting a tail-call loop?
+				const CHARM_LIST_TYPE& body = fD.functionBody;
+				RunnerContext loopContext;
+				loopContext.fA = context->fA;
+				loopContext.fD = nullptr;
+				while (1) {
+					Runner::step();
+					Runner::runWithContext(body.cbegin(), body.cend() - 1, &loopContext);
 				}
-				//ooh. the only time we use this call!
-				context->fD = &fD;
+			}
+			//ooh. the only time we use this call!
+			//(restore it afterwards, so that the caller's ifthen still sees its own definition)
+			FunctionDefinition* callerFD = context->fD;
+			context->fD = &fD;
+			if (fD.definitionInfo.memoized) {
+				Runner::runMemoized(fD, context);
+			} else {
 				Runner::runWithContext(fD.functionBody, context);
 			}
+			context->fD = callerFD;
+			return;
+		}
+		runtime_die("Unknown function `" + f.functionName + "`.");
+	}
+}
+
+void Runner::checkArguments(FunctionDefinition& fD) {
+	const CharmTypes* types = fD.definitionInfo.checkedPops;
+	unsigned long long count = fD.definitionInfo.checkedPopsCount;
+	Stack* stack = Runner::getCurrentStack();
+	for (unsigned long long n = 0; n < count && count <= stack->size(); n++) {
+		const CharmFunction& argument = stack->at(count - 1 - n);
+		if (!TypeInference::hasType(argument, types[n])) {
+			runtime_die("`" + fD.functionName + "` was passed " + charmFunctionToString(argument, PREVIEW_LIMITS) +
+				", but its type signature says it takes " + TypeInference::typeName(types[n]) + ".");
+		}
+	}
+}
+
+void Runner::runMemoized(FunctionDefinition& fD, RunnerContext* context) {
+	if (memoCaches.find(fD.functionName) == memoCaches.end()) {
+		memoCaches.emplace(fD.functionName, MemoCache(MEMO_CACHE_SIZE));
+	}
+	Stack* stack = Runner::getCurrentStack();
+	unsigned long long pops = std::min<unsigned long long>(fD.definitionInfo.memoizedPops, stack->size());
+	stack->materialize(pops);
+	CHARM_LIST_TYPE arguments(stack->stack.end() - pops, stack->stack.end());
+	const CHARM_LIST_TYPE* cachedResults = memoCaches.at(fD.functionName).lookup(arguments);
+	if (cachedResults != nullptr) {
+		//cache hit, do what the function would have done without running it
+		for (unsigned long long n = 0; n < pops; n++) {
+			stack->pop();
 		}
-		if (!functionFound) {
-			runtime_die("Unknown function `" + f.functionName + "`.");
+		for (const CharmFunction& result : *cachedResults) {
+			stack->push(result);
 		}
+		return;
 	}
+	Runner::runWithContext(fD.functionBody, context);
+	stack = Runner::getCurrentStack();
+	unsigned long long pushes = std::min<unsigned long long>(fD.definitionInfo.memoizedPushes, stack->size());
+	stack->materialize(pushes);
+	CHARM_LIST_TYPE results(stack->stack.end() - pushes, stack->stack.end());
+	//(the recursive calls might have added caches, so look this one up again)
+	memoCaches.at(fD.functionName).insert(arguments, results);
+}
+
+const std::unordered_map<std::string, MemoCache>& Runner::getMemoCaches() {
+	return Runner::memoCaches;
+}
+
+void Runner::runWithContext(const CHARM_LIST_TYPE& parsedProgram, RunnerContext* context) {
+	Runner::runWithContext(parsedProgram.cbegin(), parsedProgram.cend(), context);
 }
 
-void Runner::runWithContext(CHARM_LIST_TYPE parsedProgram, RunnerContext* context) {
-	for (CharmFunction currentFunction : parsedProgram) {
+void Runner::runWithContext(const CharmFunction* first, const CharmFunction* last, RunnerContext* context) {
+	Profiler::Window profilerWindow;
+	for (const CharmFunction* f = first; f != last; f++) {
+		const CharmFunction& currentFunction = *f;
+		Runner::step();
+		if (profiler != nullptr) {
+			bool fusable = (currentFunction.functionType == NUMBER_FUNCTION) ||
+				(currentFunction.functionType == STRING_FUNCTION) ||
+				(currentFunction.functionType == DEFINED_FUNCTION && pF->isBuiltinFunction(currentFunction.functionName));
+			profiler->recordFunction(profilerWindow, currentFunction, fusable);
+		}
 		//alright, now we get into the running portion
 		if (currentFunction.functionType == NUMBER_FUNCTION) {
 			ONLYDEBUG puts("RUNNING AS NUMBER_FUNCTION");
@@ -153,6 +430,10 @@ void Runner::runWithContext(CHARM_LIST_TYPE parsedProgram, RunnerContext* contex
 			//now we push on the lists
 			Runner::getCurrentStack()->push(currentFunction);
 			//wow this is easy right? now get ready baby
+		} else if (currentFunction.functionType == MAP_FUNCTION) {
+			ONLYDEBUG puts("RUNNING AS MAP_FUNCTION");
+			//maps aren't written in code, but they're run like anything else that's quoted
+			Runner::getCurrentStack()->push(currentFunction);
 		} else if (currentFunction.functionType == FUNCTION_DEFINITION) {
 			ONLYDEBUG puts("RUNNING AS FUNCTION_DEFINTION");
 			//lets define some functions bruh
@@ -173,7 +454,7 @@ void Runner::runWithContext(CHARM_LIST_TYPE parsedProgram, RunnerContext* contex
 	ONLYDEBUG puts("EXITING RUNNER::RUN");
 }
 
-void Runner::run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*> parsedProgramWithAnalyzer) {
+void Runner::run(const std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>& parsedProgramWithAnalyzer) {
 	RunnerContext rC;
 	rC.fA = parsedProgramWithAnalyzer.second;
 	rC.fD = nullptr;
@@ -1,15 +1,53 @@
 #pragma once
 #include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
 #include "ParserTypes.h"
 #include "Stack.h"
+#include "MemoCache.h"
+#include "Profiler.h"
+#include "CompletionIndex.h"
 
 //in PredefinedFunctions.h
 class PredefinedFunctions;
+class Runner;
+
+//a definition compiled ahead of time to C++ (see Transpiler.h)
+typedef void (*NativeFunction)(Runner*, RunnerContext*);
 
 struct FunctionDefinition {
-	std::string functionName;
+	CharmSymbol functionName;
 	CHARM_LIST_TYPE functionBody;
 	CharmFunctionDefinitionInfo definitionInfo;
+	//if this isn't nullptr, it's run instead of the body
+	NativeFunction native = nullptr;
+};
+
+//how much a Runner is allowed to do before it gives up (see Runner::setLimits). 0 means no limit
+struct ExecutionLimits {
+	//every function run is a step, and so is every trip around a tail call loop
+	unsigned long long maxSteps = 0;
+	unsigned long long timeoutMilliseconds = 0;
+	//the bytes the run has allocated and not freed yet, counted on the thread it runs on (see
+	//CharmPool::threadBytesInUse). it's checked along with the clock, so a run can go over by
+	//what it allocates in LIMIT_CHECK_INTERVAL steps
+	unsigned long long maxMemory = 0;
+	//how deeply definitions (and `i` and `ifthen`) can run inside each other. each level takes
+	//up some of the thread's stack, and running out of that kills the whole process, so unlike
+	//the others this has a limit by default: what fits in the usual 8MB stack, with room to spare
+	unsigned long long maxDepth = 2000;
+};
+
+//thrown when a limit is hit or the run is cancelled. callChain is the definitions
+//that were being run, outermost first
+class ExecutionLimitError : public std::runtime_error {
+public:
+	std::vector<std::string> callChain;
+	ExecutionLimitError(std::string message, std::vector<std::string> callChain);
 };
 
 struct Reference {
@@ -22,12 +60,23 @@ private:
 	//alright, this is the nitty gritty
 	//here is the table of function definitions:
 	std::vector<FunctionDefinition> functionDefinitions;
-	//and this is how you add them
-	void addFunctionDefinition(FunctionDefinition fD);
+	//and under it, the definitions shared with the other runners copied from this one
+	//(the prelude, and whatever was loaded before freezeDefinitions). they never change,
+	//so any number of runners can use them at once, from any thread
+	std::shared_ptr<const std::unordered_map<CharmSymbol, FunctionDefinition>> frozenDefinitions;
+	//the names in each of them, for tab completion
+	CompletionIndex definitionNames;
+	std::shared_ptr<const CompletionIndex> frozenDefinitionNames;
+	//what a name runs: this runner's own definition of it, or else the frozen one (or nullptr)
+	const FunctionDefinition* findDefinition(const CharmSymbol& functionName);
 
 	//handle the functions that we don't know about
 	//and / or handle built in functions
-	void handleDefinedFunctions(CharmFunction f, RunnerContext* context);
+	void handleDefinedFunctions(const CharmFunction& f, RunnerContext* context);
+	//run a memoized function, going through its cache
+	void runMemoized(FunctionDefinition& fD, RunnerContext* context);
+	//the caches of the memoized functions, by function name
+	std::unordered_map<std::string, MemoCache> memoCaches;
 	//this is the name of the current stack that we
 	//are working with. by default, this is stack 0
 	CharmFunction currentStackName;
@@ -35,22 +84,126 @@ private:
 	std::vector<Stack> stacks;
 	//and the list of all of our references
 	std::vector<Reference> references;
+
+	//the limits, and how far along we are
+	ExecutionLimits limits;
+	unsigned long long steps;
+	//the step at which the limits get checked next
+	unsigned long long nextCheck;
+	//what the running thread had in use when the run started (memory is counted from there)
+	long long memoryBaseline;
+	bool memoryBaselineTaken;
+	std::chrono::steady_clock::time_point deadline;
+	//set from another thread to stop the run. copies of a runner don't share it
+	struct CancelFlag {
+		std::atomic<bool> value;
+		CancelFlag() : value(false) {}
+		CancelFlag(const CancelFlag&) : value(false) {}
+		CancelFlag& operator=(const CancelFlag&) {
+			return *this;
+		}
+	};
+	CancelFlag cancelled;
+	//for a worker (see worker()), the flag of the runner it works for, which stops it too
+	const std::atomic<bool>* cancelledBy;
+	//the names of the definitions being run, for ExecutionLimitError
+	std::vector<const std::string*> callChain;
+	//how many CallFrames there are
+	unsigned long long depth;
+	void checkLimits();
+	//the error for going over a limit, naming the definitions being run
+	ExecutionLimitError limitError(std::string message);
+	void limitExceeded(std::string message);
+	//throws for the CallFrame that went past the maximum depth, after undoing what it did
+	//(its destructor won't run, since it never finished being made)
+	void depthExceeded(bool named);
 public:
 	Runner();
 	std::vector<FunctionDefinition> getFunctionDefinitions();
+	//this is how definitions get added to the table (compiled programs add theirs directly)
+	void addFunctionDefinition(FunctionDefinition fD);
+	//move this runner's definitions into the frozen layer, which its copies share. definitions
+	//made afterwards (by any of them) only go in that runner's own table, in front of the frozen ones
+	void freezeDefinitions();
+	//the builtins and definitions whose names start with prefix, sorted, for tab completion
+	std::vector<std::string> completeName(const std::string& prefix);
+	//make sure the arguments of a specialized definition are the types it relies on
+	void checkArguments(FunctionDefinition& fD);
 
 	const unsigned int MAX_STACK = 20000;
+	const unsigned int MEMO_CACHE_SIZE = 65536;
 	bool doesStackExist(CharmFunction name);
 	Stack* getCurrentStack();
 	void switchCurrentStack(CharmFunction name);
 	void createStack(unsigned long long length, CharmFunction name);
 
-	CharmFunction getReference(CharmFunction key);
+	CharmFunction getReference(const CharmFunction& key);
 	void setReference(CharmFunction key, CharmFunction value);
 
-	void runWithContext(CHARM_LIST_TYPE parsedProgram, RunnerContext* context);
-	void run(std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*> parsedProgramWithAnalyzer);
+	const std::unordered_map<std::string, MemoCache>& getMemoCaches();
+
+	//how many steps go by between checks of the clock, the memory and the cancel flag
+	const unsigned long long LIMIT_CHECK_INTERVAL = 4096;
+	//start counting against new limits (this also clears a cancel)
+	void setLimits(ExecutionLimits newLimits);
+	//make the run stop at its next check, from any thread
+	void cancel();
+	//how many steps have gone by since setLimits (only for the thread that's running)
+	unsigned long long getSteps();
+	//a copy of this runner for a builtin to run part of its work on another thread (see sortby).
+	//it has an empty stack, no profiler and no progress, and cancelling this runner cancels it
+	std::unique_ptr<Runner> worker();
+	//count the steps the workers made by worker() took as this runner's own, once they're done
+	void joinWorkers(const std::vector<std::unique_ptr<Runner>>& workers);
+	//if this is set, it's called at every check of the clock and the cancel flag, on the thread
+	//that's running, so that it can show how the run's going
+	std::function<void(Runner*)> progress;
+	//count a step, checking the limits every so often. this is run for every function
+	//and at every loop back-edge, including the ones in compiled code
+	inline void step() {
+		if (++steps >= nextCheck) {
+			Runner::checkLimits();
+		}
+	}
+	//puts a definition on the call chain for as long as it runs, and counts it towards the depth.
+	//functionName is nullptr for `i` and `ifthen`, which only count towards the depth
+	class CallFrame {
+	private:
+		Runner* r;
+		bool named;
+	public:
+		CallFrame(Runner* r, const std::string* functionName) : r(r), named(functionName != nullptr) {
+			if (named) {
+				r->callChain.push_back(functionName);
+			}
+			if (++r->depth > r->limits.maxDepth && r->limits.maxDepth > 0) {
+				r->depthExceeded(named);
+			}
+		}
+		~CallFrame() {
+			r->depth--;
+			if (named) {
+				r->callChain.pop_back();
+			}
+		}
+	};
+
+	//run the code from first up to (not including) last, without copying it. whatever it's in has to
+	//stay alive and unchanged until this returns, so callers that run code out of something that
+	//can change (like a definition in the table) run it from a copy of the list, which shares its items
+	void runWithContext(const CharmFunction* first, const CharmFunction* last, RunnerContext* context);
+	void runWithContext(const CHARM_LIST_TYPE& parsedProgram, RunnerContext* context);
+	void run(const std::pair<CHARM_LIST_TYPE, FunctionAnalyzer*>& parsedProgramWithAnalyzer);
+
+	//push onto and pop off of the current stack
+	void push(const CharmFunction& f);
+	void push(CharmFunction&& f);
+	CharmFunction pop();
 
-	// our list of predefined functions
-	PredefinedFunctions* pF;
+	// our list of predefined functions, shared with the copies of this runner
+	std::shared_ptr<PredefinedFunctions> pF;
+	//where `p`, `put` and friends write to. if it's empty, that's stdout
+	std::function<void(const std::string&)> output;
+	//if this isn't nullptr, every function that's run gets recorded in it
+	Profiler* profiler;
 };
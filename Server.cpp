@@ -0,0 +1,204 @@
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Server.h"
+#include "Error.h"
+
+//write (or read) all of it, or give up if the other end went away
+static bool writeAll(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		//(MSG_NOSIGNAL: a client going away shouldn't take the server with it)
+		ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+		if (written <= 0) {
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool readAll(int fd, char* data, size_t size) {
+	while (size > 0) {
+		ssize_t got = read(fd, data, size);
+		if (got <= 0) {
+			return false;
+		}
+		data += got;
+		size -= got;
+	}
+	return true;
+}
+
+static bool socketAddress(std::string socketPath, sockaddr_un& address) {
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		return false;
+	}
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	return true;
+}
+
+bool Server::writeFrame(int fd, char type, const std::string& payload) {
+	unsigned char header[5];
+	header[0] = type;
+	header[1] = (payload.size() >> 24) & 0xff;
+	header[2] = (payload.size() >> 16) & 0xff;
+	header[3] = (payload.size() >> 8) & 0xff;
+	header[4] = payload.size() & 0xff;
+	return writeAll(fd, (const char*)header, sizeof(header)) && writeAll(fd, payload.data(), payload.size());
+}
+
+bool Server::readFrame(int fd, char& type, std::string& payload) {
+	unsigned char header[5];
+	if (!readAll(fd, (char*)header, sizeof(header))) {
+		return false;
+	}
+	type = header[0];
+	size_t size = ((size_t)header[1] << 24) | ((size_t)header[2] << 16) | ((size_t)header[3] << 8) | header[4];
+	payload.resize(size);
+	return readAll(fd, &payload[0], size);
+}
+
+Server::Server(std::string socketPath, const Parser& parser, const Runner& runner, ExecutionLimits limits, unsigned int workers)
+	: socketPath(socketPath), parser(parser), runner(runner), limits(limits), workers(workers), requestCount(0) {}
+
+int Server::serve() {
+	sockaddr_un address;
+	if (!socketAddress(socketPath, address)) {
+		printf("Error: the socket path %s is too long.\n", socketPath.c_str());
+		return -1;
+	}
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	//(a socket left over from an earlier server is in the way)
+	unlink(socketPath.c_str());
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+		printf("Error: couldn't listen on %s: %s\n", socketPath.c_str(), strerror(errno));
+		return -1;
+	}
+	fprintf(stderr, "Listening on %s with %u workers.\n", socketPath.c_str(), workers);
+	std::vector<std::thread> pool;
+	for (unsigned int n = 0; n < workers; n++) {
+		pool.emplace_back(&Server::work, this);
+	}
+	while (true) {
+		int connection = accept(listener, nullptr, nullptr);
+		if (connection < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			printf("Error: couldn't accept a connection: %s\n", strerror(errno));
+			break;
+		}
+		std::lock_guard<std::mutex> lock(connectionsMutex);
+		connections.push_back(connection);
+		connectionsReady.notify_one();
+	}
+	close(listener);
+	//the workers are stuck waiting on connections that won't come
+	for (std::thread& worker : pool) {
+		worker.detach();
+	}
+	return -1;
+}
+
+void Server::work() {
+	while (true) {
+		int connection;
+		{
+			std::unique_lock<std::mutex> lock(connectionsMutex);
+			connectionsReady.wait(lock, [this]() { return !connections.empty(); });
+			connection = connections.front();
+			connections.pop_front();
+		}
+		Server::handle(connection);
+		close(connection);
+	}
+}
+
+void Server::handle(int connection) {
+	//the client sends the whole script, and then closes its end
+	std::string source;
+	char buffer[4096];
+	ssize_t got;
+	while ((got = read(connection, buffer, sizeof(buffer))) > 0) {
+		source.append(buffer, got);
+	}
+	unsigned long long request = ++requestCount;
+	auto start = std::chrono::steady_clock::now();
+	//a fresh copy of everything, so that nothing a script does is seen by the next one
+	Parser requestParser = parser;
+	Runner requestRunner = runner;
+	requestRunner.output = [connection](const std::string& text) {
+		Server::writeFrame(connection, OUTPUT_FRAME, text);
+	};
+	requestRunner.setLimits(limits);
+	std::string error;
+	try {
+		std::string line;
+		std::stringstream in(source);
+		while (std::getline(in, line)) {
+			requestRunner.run(requestParser.lex(line));
+		}
+	} catch (std::exception &e) {
+		error = e.what();
+		Server::writeFrame(connection, ERROR_FRAME, error);
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::stringstream took;
+	took << milliseconds;
+	Server::writeFrame(connection, DONE_FRAME, took.str());
+	fprintf(stderr, "Request %llu: %.3f ms%s%s\n", request, milliseconds, error.empty() ? "" : ", stopped with: ", error.c_str());
+}
+
+int Server::runClient(std::string socketPath, std::string fileName) {
+	sockaddr_un address;
+	int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (!socketAddress(socketPath, address) || connection < 0 || connect(connection, (sockaddr*)&address, sizeof(address)) < 0) {
+		printf("Error: couldn't connect to a server on %s.\n", socketPath.c_str());
+		return -1;
+	}
+	std::ifstream inFile(fileName);
+	std::stringstream source;
+	source << inFile.rdbuf();
+	std::string script = source.str();
+	if (!writeAll(connection, script.data(), script.size())) {
+		printf("Error: the server on %s went away.\n", socketPath.c_str());
+		return -1;
+	}
+	shutdown(connection, SHUT_WR);
+	int exitCode = 0;
+	char type;
+	std::string payload;
+	while (Server::readFrame(connection, type, payload)) {
+		if (type == OUTPUT_FRAME) {
+			fwrite(payload.data(), 1, payload.size(), stdout);
+			fflush(stdout);
+		} else if (type == ERROR_FRAME) {
+			//the same as running the file directly
+			printf("%s nonexistant or unopenable.\n", fileName.c_str());
+			printf("Error: %s\n", payload.c_str());
+			exitCode = -1;
+		} else if (type == DONE_FRAME) {
+			fflush(stdout);
+			fprintf(stderr, "Ran in %s ms on the server.\n", payload.c_str());
+			close(connection);
+			return exitCode;
+		}
+	}
+	printf("Error: the server on %s went away.\n", socketPath.c_str());
+	close(connection);
+	return -1;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "Parser.h"
+#include "Runner.h"
+
+//`charm --serve <socket>` keeps a parser and a runner with the prelude already loaded, and runs the
+//scripts that `charm --client <socket> <input file>` sends it on a pool of threads, each one in its
+//own copy of them. what the script writes is streamed back as it's written, in frames: a type byte,
+//the length of the payload (4 bytes, big endian), and then the payload
+class Server {
+public:
+	//something the script wrote
+	static const char OUTPUT_FRAME = 'o';
+	//the error the script stopped with
+	static const char ERROR_FRAME = 'e';
+	//the last frame: how long the script took on the server, in milliseconds
+	static const char DONE_FRAME = 'd';
+private:
+	std::string socketPath;
+	//everything the scripts start from. these are only ever copied once the server is up
+	const Parser parser;
+	const Runner runner;
+	ExecutionLimits limits;
+	unsigned int workers;
+	//the connections waiting for a worker
+	std::deque<int> connections;
+	std::mutex connectionsMutex;
+	std::condition_variable connectionsReady;
+	std::atomic<unsigned long long> requestCount;
+
+	void work();
+	void handle(int connection);
+public:
+	Server(std::string socketPath, const Parser& parser, const Runner& runner, ExecutionLimits limits, unsigned int workers);
+	//accept connections until something goes wrong, returns the exit code
+	int serve();
+	//send the input file to a server and print what comes back, returns the exit code
+	static int runClient(std::string socketPath, std::string fileName);
+
+	static bool writeFrame(int fd, char type, const std::string& payload);
+	static bool readFrame(int fd, char& type, std::string& payload);
+};
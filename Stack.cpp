@@ -1,19 +1,25 @@
 #include "Stack.h"
 #include "ParserTypes.h"
+#include "Error.h"
 
 #include <algorithm>
+#include <utility>
 
 CharmFunction Stack::zeroF() {
-	CharmFunction zeroFunction;
-	CharmNumber zeroNumber;
-	zeroNumber.whichType = INTEGER_VALUE;
-	zeroNumber.integerValue = 0;
-	zeroFunction.functionType = NUMBER_FUNCTION;
-	zeroFunction.numberValue = zeroNumber;
-	return zeroFunction;
+	return Stack::intF(0);
 }
 
-bool Stack::isInt(CharmFunction f) {
+CharmFunction Stack::intF(long long n) {
+	CharmFunction intFunction;
+	CharmNumber number;
+	number.whichType = INTEGER_VALUE;
+	number.integerValue = n;
+	intFunction.functionType = NUMBER_FUNCTION;
+	intFunction.numberValue = number;
+	return intFunction;
+}
+
+bool Stack::isInt(const CharmFunction& f) {
 	if (f.functionType == NUMBER_FUNCTION) {
 		if (f.numberValue.whichType == INTEGER_VALUE) {
 			return true;
@@ -22,7 +28,7 @@ bool Stack::isInt(CharmFunction f) {
 	return false;
 }
 
-bool Stack::isFloat(CharmFunction f) {
+bool Stack::isFloat(const CharmFunction& f) {
 	if (f.functionType == NUMBER_FUNCTION) {
 		if (f.numberValue.whichType == FLOAT_VALUE) {
 			return true;
@@ -31,44 +37,114 @@ bool Stack::isFloat(CharmFunction f) {
 	return false;
 }
 
-bool Stack::isNameEqualTo(CharmFunction f) {
+bool Stack::isNameEqualTo(const CharmFunction& f) {
     return (Stack::name == f);
 }
 
 Stack::Stack(unsigned long long size, CharmFunction name) {
     Stack::modifiedStackArea = 0;
-	for (unsigned long long stackIndex = 0; stackIndex < size; stackIndex++) {
+    Stack::stackShift = 0;
+    Stack::capacity = size;
+    Stack::name = name;
+}
+
+unsigned long long Stack::size() {
+	return Stack::capacity;
+}
+
+CharmFunction& Stack::peek(unsigned long long n) {
+	if (n >= Stack::capacity) {
+		runtime_die("Tried to reach under the bottom of the stack.");
+	}
+	Stack::materialize(n + 1);
+	Stack::markModified(n);
+	return Stack::stack[Stack::stack.size() - 1 - n];
+}
+
+CharmFunction& Stack::top() {
+	if (Stack::stack.empty()) {
 		Stack::stack.push_back(Stack::zeroF());
 	}
-    Stack::name = name;
+	if (Stack::modifiedStackArea == 0) Stack::modifiedStackArea = 1;
+	return Stack::stack.back();
+}
+
+const CharmFunction& Stack::at(unsigned long long n) const {
+	static const CharmFunction zero = Stack::zeroF();
+	if (n >= Stack::stack.size()) {
+		if (n >= Stack::capacity) {
+			runtime_die("Tried to reach under the bottom of the stack.");
+		}
+		return zero;
+	}
+	return Stack::stack[Stack::stack.size() - 1 - n];
+}
+
+void Stack::materialize(unsigned long long n) {
+	n = std::min(n, Stack::capacity);
+	while (Stack::stack.size() < n) {
+		Stack::stack.push_front(Stack::zeroF());
+	}
+}
+
+
+unsigned long long Stack::getModifiedStackArea() {
+	return Stack::modifiedStackArea;
+}
+
+long long Stack::getStackShift() {
+	return Stack::stackShift;
 }
 
+void Stack::clearModifiedStackArea() {
+	Stack::modifiedStackArea = 0;
+	Stack::stackShift = 0;
+}
 
-unsigned int Stack::getModifiedStackArea() {
-    return Stack::modifiedStackArea;
+void Stack::markModified(unsigned long long n) {
+	if (n + 1 > Stack::modifiedStackArea) Stack::modifiedStackArea = std::min(n + 1, Stack::capacity);
 }
 
 
 CharmFunction Stack::pop() {
-	//ensure that the stack never changes size
-	//this is by placing more zeroes at the start
-	//as stuff is popped off the end
-	Stack::stack.insert(Stack::stack.begin(), Stack::zeroF());
-	CharmFunction tempCharmF = Stack::stack.at(Stack::stack.size() - 1);
-	Stack::stack.pop_back();
+	//the stack never changes size: popping the last stored value
+	//leaves a zero at the bottom, just like the ones under it
+	//everything moves up one (with a zero coming in at the bottom, past anything that's tracked)
 	if (Stack::modifiedStackArea != 0) Stack::modifiedStackArea--;
+	Stack::stackShift--;
+	if (Stack::stack.empty()) {
+		return Stack::zeroF();
+	}
+	CharmFunction tempCharmF = std::move(Stack::stack.back());
+	Stack::stack.pop_back();
 	return tempCharmF;
 }
 
-void Stack::push(CharmFunction f) {
+void Stack::dropBottom() {
 	//ensure the stack never changes size again
-	//pop an element off the back of the stack
+	//if it's full, the bottom value falls off
+	if (Stack::stack.size() > Stack::capacity) {
+		Stack::stack.pop_front();
+	}
+}
+
+void Stack::push(const CharmFunction& f) {
 	Stack::stack.push_back(f);
-	Stack::stack.erase(Stack::stack.begin());
-	Stack::modifiedStackArea++;
+	Stack::dropBottom();
+	//everything that was there moves down one, under the new value
+	if (Stack::modifiedStackArea < Stack::capacity) Stack::modifiedStackArea++;
+	Stack::stackShift++;
+}
+
+void Stack::push(CharmFunction&& f) {
+	Stack::stack.push_back(std::move(f));
+	Stack::dropBottom();
+	if (Stack::modifiedStackArea < Stack::capacity) Stack::modifiedStackArea++;
+	Stack::stackShift++;
 }
 
 void Stack::swap(unsigned long long n1, unsigned long long n2) {
+	Stack::materialize(std::max(n1, n2) + 1);
 	/*CharmFunction tempFromN1 = Stack::stack.at(Stack::stack.size() - n1 - 1);
 	CharmFunction tempFromN2 = Stack::stack.at(Stack::stack.size() - n2 - 1);
 	Stack::stack[Stack::stack.size() - n1 - 1] = tempFromN2;
@@ -76,6 +152,6 @@ void Stack::swap(unsigned long long n1, unsigned long long n2) {
 	Stack::updateModifiedStackArea();
 	*/
 	std::iter_swap(Stack::stack.end() - n1 - 1, Stack::stack.end() - n2 - 1);
-	if (n1 + 1 > Stack::modifiedStackArea) Stack::modifiedStackArea = n1;
-	if (n2 + 1 > Stack::modifiedStackArea) Stack::modifiedStackArea = n2;
+	Stack::markModified(n1);
+	Stack::markModified(n2);
 }
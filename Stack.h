@@ -1,33 +1,66 @@
 #pragma once
 #include "ParserTypes.h"
 #include <deque>
+#include <utility>
 
 class Stack {
 private:
-	//says how much of the stack was changed, for printing n stuff
+	//says how much of the stack was changed, for printing n stuff: since clearModifiedStackArea(),
+	//the values under the top modifiedStackArea are the ones that were stackShift further up
+	//(or down, if it's negative) before, and only the ones on top of them might be different
 	unsigned long long modifiedStackArea;
+	long long stackShift;
+	//the value n from the top might have been changed
+	void markModified(unsigned long long n);
+	//how many values the stack holds, zeros included
+	unsigned long long capacity;
+	//if the stack's gone over its capacity, the bottom value falls off
+	void dropBottom();
 public:
     CharmFunction name;
     Stack(unsigned long long size, CharmFunction name);
-    //the stack is automatically initialized to MAX_INT zero ints
+    //the stack is always full of zero ints under what's been pushed, but only the top
+    //of it is stored here (deepest first), so that new stacks are cheap
     CHARM_STACK_TYPE stack;
+    //how many values the stack holds, zeros included. this never changes
+    unsigned long long size();
+    //the value n from the top (zero-indexed), which can be changed in place
+    CharmFunction& peek(unsigned long long n);
+    //the value on top, which can be changed in place (so a builtin that takes
+    //one value and gives back one can work on it where it is)
+    CharmFunction& top();
+    //the value n from the top, just to look at (it doesn't count as modified, or fill in zeros)
+    const CharmFunction& at(unsigned long long n) const;
+    //make sure at least the top n values are stored, so that stack can be indexed that deep
+    void materialize(unsigned long long n);
     //check to see if the stack name is equal
     //to some CharmFunction passed in. this is so
     //runner can properly select its current stack
-    bool isNameEqualTo(CharmFunction f);
-    //update the modifiedStackArea, really only called on swap
-    //because swap is the only one that's hard to predict
-	void updateModifiedStackArea();
+    bool isNameEqualTo(const CharmFunction& f);
+    //what's changed since the last clearModifiedStackArea() (see modifiedStackArea)
+    unsigned long long getModifiedStackArea();
+    long long getStackShift();
+    void clearModifiedStackArea();
     //a helper function to see if a charm function is a number / an int
-    static bool isInt(CharmFunction f);
-    static bool isFloat(CharmFunction f);
+    static bool isInt(const CharmFunction& f);
+    static bool isFloat(const CharmFunction& f);
     //return a CharmFunction that for all intents and purposes is zero
     static CharmFunction zeroF();
+    static CharmFunction intF(long long n);
     //push to top of stack
-    void push(CharmFunction f);
-    //pop off top of stack
+    void push(const CharmFunction& f);
+    void push(CharmFunction&& f);
+    //push a value made out of args, and return it so that it can be filled in
+    template <typename... Args>
+    CharmFunction& emplace(Args&&... args) {
+        Stack::stack.emplace_back(std::forward<Args>(args)...);
+        Stack::dropBottom();
+        if (Stack::modifiedStackArea < Stack::capacity) Stack::modifiedStackArea++;
+        Stack::stackShift++;
+        return Stack::stack.back();
+    }
+    //pop off top of stack (the value is moved out, not copied)
     CharmFunction pop();
     //swap values at index n1 and n2 from the top (zero-indexed)
     void swap(unsigned long long n1, unsigned long long n2);
-    unsigned int getModifiedStackArea();
 };
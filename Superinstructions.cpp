@@ -0,0 +1,159 @@
+#include <algorithm>
+
+#include "Superinstructions.h"
+#include "FunctionAnalyzer.h"
+#include "ParserTypes.h"
+#include "Stack.h"
+
+//a tiny version of the parser, just enough for the patterns below
+static CHARM_LIST_TYPE patternFromString(std::string s) {
+	CHARM_LIST_TYPE out;
+	std::stringstream sS(s);
+	std::string token;
+	while (sS >> token) {
+		CharmFunction f;
+		if (token == "\"") {
+			f.functionType = STRING_FUNCTION;
+			std::string stringValue;
+			sS >> stringValue;
+			f.stringValue = stringValue;
+			sS >> token;
+		} else if (token.find_first_not_of("-0123456789") == std::string::npos && token.find_first_of("0123456789") != std::string::npos) {
+			f = Stack::zeroF();
+			f.numberValue.integerValue = std::stoll(token);
+		} else {
+			f.functionType = DEFINED_FUNCTION;
+			f.functionName = token;
+		}
+		out.push_back(f);
+	}
+	return out;
+}
+
+static Superinstruction makeSuperinstruction(std::string name, std::string pattern) {
+	Superinstruction s;
+	s.name = name;
+	s.pattern = patternFromString(pattern);
+	return s;
+}
+
+const std::vector<Superinstruction>& Superinstructions::table() {
+	//the first pattern for each name is the one it expands back into (with the
+	//integer in front of it filled into the wildcard). longer patterns are tried first.
+	static const std::vector<Superinstruction> superinstructions = []() {
+		std::vector<Superinstruction> out = {
+			//copyfrom, with the index on the stack or known ahead of time
+			makeSuperinstruction("%copyfrom", "\" copyfromref \" 0 1 swap setref 0 \" copyfromref \" getref swap dup 1 \" copyfromref \" getref 1 + swap"),
+			makeSuperinstruction("%copyfrom", "\" copyfromref \" %int setref 0 \" copyfromref \" getref swap dup 1 \" copyfromref \" getref 1 + swap"),
+			//dup <n> copyfrom (the head of pushto's loop, amongst others)
+			//(without a known n, the dup would copy n itself, which isn't what %dupcopyfrom does)
+			makeSuperinstruction("%dupcopyfrom", "dup \" copyfromref \" %int setref 0 \" copyfromref \" getref swap dup 1 \" copyfromref \" getref 1 + swap"),
+			//flip <n> + flip
+			makeSuperinstruction("%addunder", "0 1 swap %int + 0 1 swap"),
+			//swapnth
+			makeSuperinstruction("%swapnth", "dup 1 + swap"),
+			//1 2 swap concat (map's inner loop)
+			makeSuperinstruction("%swap12concat", "1 2 swap concat"),
+			//put
+			makeSuperinstruction("%put", "dup p newline"),
+			//flip
+			makeSuperinstruction("%flip", "0 1 swap")
+		};
+		std::stable_sort(out.begin(), out.end(), [](const Superinstruction& a, const Superinstruction& b) {
+			return a.pattern.size() > b.pattern.size();
+		});
+		return out;
+	}();
+	return superinstructions;
+}
+
+bool Superinstructions::isSuperinstruction(const std::string& fName) {
+	return (fName.size() > 1) && (fName[0] == '%');
+}
+
+static bool isWildcard(const CharmFunction& f) {
+	return (f.functionType == DEFINED_FUNCTION) && (f.functionName == "%int");
+}
+
+bool Superinstructions::matchesAt(const CHARM_LIST_TYPE& body, unsigned long long start, const Superinstruction& s, CHARM_LIST_TYPE& captured) {
+	if (start + s.pattern.size() > body.size()) {
+		return false;
+	}
+	captured.clear();
+	for (unsigned long long n = 0; n < s.pattern.size(); n++) {
+		const CharmFunction& f = body[start + n];
+		if (isWildcard(s.pattern[n])) {
+			if (!Stack::isInt(f)) return false;
+			captured.push_back(f);
+		} else if (!(f == s.pattern[n])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned long long Superinstructions::fuse(CHARM_LIST_TYPE& body) {
+	unsigned long long fused = 0;
+	std::vector<bool> isCode = FunctionAnalyzer::findCodeQuotations(body);
+	CHARM_LIST_TYPE out;
+	CHARM_LIST_TYPE captured;
+	unsigned long long n = 0;
+	while (n < body.size()) {
+		bool matched = false;
+		for (const Superinstruction& s : table()) {
+			if (matchesAt(body, n, s, captured)) {
+				out.insert(out.end(), captured.begin(), captured.end());
+				CharmFunction superinstruction;
+				superinstruction.functionType = DEFINED_FUNCTION;
+				superinstruction.functionName = s.name;
+				out.push_back(superinstruction);
+				n += s.pattern.size();
+				fused++;
+				matched = true;
+				break;
+			}
+		}
+		if (matched) continue;
+		CharmFunction f = body[n];
+		if (isCode[n]) {
+			fused += fuse(f.literalFunctions);
+		}
+		out.push_back(f);
+		n++;
+	}
+	body = out;
+	return fused;
+}
+
+void Superinstructions::expand(CHARM_LIST_TYPE& body) {
+	std::vector<bool> isCode = FunctionAnalyzer::findCodeQuotations(body);
+	CHARM_LIST_TYPE out;
+	for (unsigned long long n = 0; n < body.size(); n++) {
+		CharmFunction f = body[n];
+		if (f.functionType == DEFINED_FUNCTION && isSuperinstruction(f.functionName)) {
+			auto sIter = std::find_if(table().begin(), table().end(), [&f](const Superinstruction& s) {
+				return s.name == f.functionName;
+			});
+			bool hasWildcard = (sIter != table().end()) && std::any_of(sIter->pattern.begin(), sIter->pattern.end(), isWildcard);
+			if (sIter != table().end() && !hasWildcard) {
+				out.insert(out.end(), sIter->pattern.begin(), sIter->pattern.end());
+				continue;
+			}
+			if (hasWildcard && out.size() > 0 && Stack::isInt(out.back())) {
+				//fuse() put the integer the wildcard matched right in front of it
+				CharmFunction immediate = out.back();
+				out.pop_back();
+				for (const CharmFunction& patternF : sIter->pattern) {
+					out.push_back(isWildcard(patternF) ? immediate : patternF);
+				}
+				continue;
+			}
+			//otherwise it stays a superinstruction, which does the same thing anyway
+		}
+		if (isCode[n]) {
+			expand(f.literalFunctions);
+		}
+		out.push_back(f);
+	}
+	body = out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "ParserTypes.h"
+
+//superinstructions are builtins (with names starting with %) that do the work
+//of a common sequence of functions in a single dispatch. their implementations
+//are in PredefinedFunctions.cpp, this is the table of what they replace.
+struct Superinstruction {
+	std::string name;
+	//the sequence that gets replaced. a DEFINED_FUNCTION named "%int" matches any
+	//integer literal, which is kept in front of the superinstruction
+	CHARM_LIST_TYPE pattern;
+};
+
+class Superinstructions {
+private:
+	static const std::vector<Superinstruction>& table();
+	static bool matchesAt(const CHARM_LIST_TYPE& body, unsigned long long start, const Superinstruction& s, CHARM_LIST_TYPE& captured);
+public:
+	//replace every known sequence in the body with its superinstruction,
+	//returns how many were replaced
+	static unsigned long long fuse(CHARM_LIST_TYPE& body);
+	//the opposite of fuse, so that other passes can see through superinstructions
+	static void expand(CHARM_LIST_TYPE& body);
+	static bool isSuperinstruction(const std::string& fName);
+};
@@ -0,0 +1,449 @@
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <climits>
+
+#include "Transpiler.h"
+#include "ParserTypes.h"
+#include "Error.h"
+
+//the start of every generated program: the tables setup() fills, and the helpers the compiled code calls
+static const char* RUNTIME_SUPPORT = R"(#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <variant>
+
+#include "Charm.h"
+#include "Runner.h"
+#include "PredefinedFunctions.h"
+#include "FunctionAnalyzer.h"
+#include "TypeInference.h"
+#include "Error.h"
+#include "Output.h"
+
+//the literals the program pushes, the builtins and the names it calls, and its definitions
+static std::vector<CharmFunction> literals;
+static std::vector<BuiltinFunction*> builtins;
+static std::vector<CHARM_LIST_TYPE> calls;
+//the compiled version of what each name is currently defined as (nullptr if there isn't one)
+static std::vector<NativeFunction> natives;
+static std::vector<FunctionDefinition> definitions;
+
+static CharmFunctionDefinitionInfo info(bool inlineable, bool tailCallRecursive, bool memoized,
+	unsigned long long memoizedPops, unsigned long long memoizedPushes, std::vector<CharmTypes> checkedPops) {
+	CharmFunctionDefinitionInfo out = CharmFunctionDefinitionInfo();
+	out.inlineable = inlineable;
+	out.tailCallRecursive = tailCallRecursive;
+	out.memoized = memoized;
+	out.memoizedPops = memoizedPops;
+	out.memoizedPushes = memoizedPushes;
+	out.checkedPopsCount = checkedPops.size();
+	for (unsigned int n = 0; n < checkedPops.size(); n++) {
+		out.checkedPops[n] = checkedPops[n];
+	}
+	return out;
+}
+
+static FunctionDefinition definition(std::string name, CHARM_LIST_TYPE body, CharmFunctionDefinitionInfo definitionInfo) {
+	FunctionDefinition fD;
+	fD.functionName = name;
+	fD.functionBody = body;
+	fD.definitionInfo = definitionInfo;
+	return fD;
+}
+
+static inline void runBuiltin(unsigned long long n, Runner* r, RunnerContext* context) {
+	BuiltinFunction* b = builtins[n];
+	if (b->takesContext) {
+		std::get<std::function<void(Runner*, RunnerContext*)>>(b->f)(r, context);
+	} else {
+		std::get<std::function<void(Runner*)>>(b->f)(r);
+	}
+}
+
+static inline void runDefined(unsigned long long n, Runner* r, RunnerContext* context) {
+	if (natives[n] != nullptr) {
+		natives[n](r, context);
+	} else {
+		//not compiled (memoized, or not defined at all): the runner knows what to do
+		r->runWithContext(calls[n], context);
+	}
+}
+
+//pops the condition of an `ifthen`
+static inline bool condition(Runner* r) {
+	CharmFunction cond = r->getCurrentStack()->pop();
+	if (!Stack::isInt(cond)) {
+		runtime_die("`ifthen` condition returned non integer.");
+	}
+	return (cond.numberValue.integerValue > 0);
+}
+
+//what running the FUNCTION_DEFINITION would have done
+static void define(unsigned long long d, unsigned long long n, NativeFunction native, Runner* r, FunctionAnalyzer* fA) {
+	FunctionDefinition fD = definitions[d];
+	fD.native = native;
+	r->addFunctionDefinition(fD);
+	natives[n] = native;
+	if (fD.definitionInfo.inlineable) {
+		//so that `inline` still has it
+		CharmFunction f = CharmFunction();
+		f.functionType = FUNCTION_DEFINITION;
+		f.functionName = fD.functionName;
+		f.literalFunctions = fD.functionBody;
+		f.definitionInfo = fD.definitionInfo;
+		TypeInference::despecialize(f.literalFunctions);
+		fA->addToInlineDefinitions(f);
+	}
+}
+)";
+
+//how much of a literal gets shown in the comment next to it
+static const unsigned int COMMENT_LENGTH = 60;
+
+static std::string comment(std::string out) {
+	for (char& c : out) {
+		if (c == '\n' || c == '\r') {
+			c = ' ';
+		} else if (c == '\\') {
+			//a backslash at the end would continue the comment onto the next line
+			c = '/';
+		}
+	}
+	if (out.size() > COMMENT_LENGTH) {
+		out = out.substr(0, COMMENT_LENGTH) + "...";
+	}
+	return out;
+}
+
+static std::string typeExpression(CharmTypes t) {
+	switch (t) {
+		case TYPESIG_ANY: return "TYPESIG_ANY";
+		case TYPESIG_LIST: return "TYPESIG_LIST";
+		case TYPESIG_LISTSTRING: return "TYPESIG_LISTSTRING";
+		case TYPESIG_STRING: return "TYPESIG_STRING";
+		case TYPESIG_INT: return "TYPESIG_INT";
+		case TYPESIG_FLOAT: return "TYPESIG_FLOAT";
+		case TYPESIG_MAP: return "TYPESIG_MAP";
+	}
+	return "TYPESIG_ANY";
+}
+
+Transpiler::Transpiler(std::string sourceName) {
+	Transpiler::sourceName = sourceName;
+	lineCount = 0;
+}
+
+std::string Transpiler::quote(const std::string& s) {
+	std::stringstream out;
+	out << "\"";
+	for (unsigned char c : s) {
+		if (c == '"' || c == '\\') {
+			out << "\\" << c;
+		} else if (c >= 0x20 && c < 0x7f) {
+			out << c;
+		} else {
+			//always three digits, so the next character can't be read as part of it
+			out << "\\" << std::oct << std::setw(3) << std::setfill('0') << (unsigned int)c << std::dec;
+		}
+	}
+	out << "\"";
+	return out.str();
+}
+
+std::string Transpiler::expression(const CharmFunction& f) {
+	std::stringstream out;
+	switch (f.functionType) {
+		case NUMBER_FUNCTION:
+		if (f.numberValue.whichType == INTEGER_VALUE) {
+			if (f.numberValue.integerValue == LLONG_MIN) {
+				out << "charmInteger(-" << LLONG_MAX << "LL - 1)";
+			} else {
+				out << "charmInteger(" << f.numberValue.integerValue << "LL)";
+			}
+		} else {
+			long double n = f.numberValue.floatValue;
+			if (std::isnan(n)) {
+				out << "charmFloat(std::numeric_limits<long double>::quiet_NaN())";
+			} else if (std::isinf(n)) {
+				out << "charmFloat(" << (n < 0 ? "-" : "") << "std::numeric_limits<long double>::infinity())";
+			} else {
+				//hex floats are exact
+				out << "charmFloat(" << std::hexfloat << n << std::defaultfloat << "L)";
+			}
+		}
+		break;
+
+		case STRING_FUNCTION:
+		out << "charmString(" << quote(f.stringValue.str()) << ")";
+		break;
+
+		case DEFINED_FUNCTION:
+		out << "charmCall(" << quote(f.functionName) << ")";
+		break;
+
+		case LIST_FUNCTION:
+		out << "charmList({";
+		for (unsigned long long n = 0; n < f.literalFunctions.size(); n++) {
+			out << (n == 0 ? " " : ", ") << expression(f.literalFunctions[n]);
+		}
+		out << " })";
+		break;
+
+		case FUNCTION_DEFINITION:
+		runtime_die("Can't compile a definition inside of a list.");
+		break;
+
+		case MAP_FUNCTION:
+		//(maps are only ever made while running, so there's nothing to write one out as)
+		runtime_die("Can't compile a map.");
+		break;
+	}
+	return out.str();
+}
+
+std::string Transpiler::infoExpression(const CharmFunctionDefinitionInfo& info) {
+	std::stringstream out;
+	out << "info(" << (info.inlineable ? "true" : "false") << ", "
+		<< (info.tailCallRecursive ? "true" : "false") << ", "
+		<< (info.memoized ? "true" : "false") << ", ";
+	if (info.memoized) {
+		out << info.memoizedPops << ", " << info.memoizedPushes << ", {";
+	} else {
+		out << "0, 0, {";
+	}
+	for (unsigned int n = 0; n < info.checkedPopsCount; n++) {
+		out << (n == 0 ? " " : ", ") << typeExpression(info.checkedPops[n]);
+	}
+	out << " })";
+	return out.str();
+}
+
+unsigned long long Transpiler::literalIndex(const CharmFunction& f) {
+	literals.push_back(expression(f));
+	return literals.size() - 1;
+}
+
+unsigned long long Transpiler::builtinIndex(const std::string& fName) {
+	auto found = builtinIndices.find(fName);
+	if (found != builtinIndices.end()) {
+		return found->second;
+	}
+	builtins.push_back(fName);
+	builtinIndices[fName] = builtins.size() - 1;
+	return builtins.size() - 1;
+}
+
+unsigned long long Transpiler::nameIndex(const std::string& fName) {
+	auto found = nameIndices.find(fName);
+	if (found != nameIndices.end()) {
+		return found->second;
+	}
+	names.push_back(fName);
+	nameIndices[fName] = names.size() - 1;
+	return names.size() - 1;
+}
+
+void Transpiler::emitIfthen(std::ostream& out, const CharmFunction& cond, const CharmFunction& truthy, const CharmFunction& falsy,
+	const std::string& context, const std::string& tailName, unsigned int depth, unsigned int& contexts) {
+	//this follows PredefinedFunctions.cpp::ifthen() exactly, tail calls included, and
+	//counts towards the depth the same way (for as long as it runs, loop and all)
+	std::string indent(depth, '\t');
+	out << indent << "{\n";
+	out << indent << "\tRunner::CallFrame ifthenFrame(r, nullptr);\n";
+	depth++;
+	indent += '\t';
+	bool truthyTailCall = (tailName != "" && truthy.literalFunctions.size() > 0 && truthy.literalFunctions.back().functionName == tailName);
+	bool falsyTailCall = (tailName != "" && falsy.literalFunctions.size() > 0 && falsy.literalFunctions.back().functionName == tailName);
+	if (truthyTailCall || falsyTailCall) {
+		//loop on the branch that ends in the tail call, the other one ends the loop
+		//(ifthen checks the truthy branch first, so that's the one that loops if both do)
+		CHARM_LIST_TYPE truthyBody = truthy.literalFunctions;
+		CHARM_LIST_TYPE falsyBody = falsy.literalFunctions;
+		if (truthyTailCall) {
+			truthyBody.pop_back();
+		} else {
+			falsyBody.pop_back();
+		}
+		out << indent << "while (true) {\n";
+		out << indent << "\tr->step();\n";
+		emitBody(out, cond.literalFunctions, context, tailName, depth + 1, contexts);
+		out << indent << "\tif (condition(r)) {\n";
+		emitBody(out, truthyBody, context, tailName, depth + 2, contexts);
+		if (!truthyTailCall) {
+			out << indent << "\t\tbreak;\n";
+		}
+		out << indent << "\t} else {\n";
+		emitBody(out, falsyBody, context, tailName, depth + 2, contexts);
+		if (truthyTailCall) {
+			out << indent << "\t\tbreak;\n";
+		}
+		out << indent << "\t}\n";
+		out << indent << "}\n";
+	} else {
+		emitBody(out, cond.literalFunctions, context, tailName, depth, contexts);
+		out << indent << "if (condition(r)) {\n";
+		emitBody(out, truthy.literalFunctions, context, tailName, depth + 1, contexts);
+		out << indent << "} else {\n";
+		emitBody(out, falsy.literalFunctions, context, tailName, depth + 1, contexts);
+		out << indent << "}\n";
+	}
+	out << std::string(depth - 1, '\t') << "}\n";
+}
+
+void Transpiler::emitBody(std::ostream& out, const CHARM_LIST_TYPE& body, const std::string& context,
+	const std::string& tailName, unsigned int depth, unsigned int& contexts) {
+	std::string indent(depth, '\t');
+	auto isCall = [&body](unsigned long long n, std::string fName) {
+		return (n < body.size() && body[n].functionType == DEFINED_FUNCTION && body[n].functionName == fName);
+	};
+	auto isList = [&body](unsigned long long n) {
+		return (n < body.size() && body[n].functionType == LIST_FUNCTION);
+	};
+	for (unsigned long long n = 0; n < body.size(); n++) {
+		const CharmFunction& f = body[n];
+		if (isList(n) && isList(n + 1) && isList(n + 2) && isCall(n + 3, "ifthen")) {
+			emitIfthen(out, body[n], body[n + 1], body[n + 2], context, tailName, depth, contexts);
+			n += 3;
+		} else if (isList(n) && isCall(n + 1, "i")) {
+			//`i` runs its list without the definition, so it can't tail call
+			std::string inner = "context" + std::to_string(++contexts);
+			out << indent << "{\n";
+			out << indent << "\tRunner::CallFrame iFrame(r, nullptr);\n";
+			out << indent << "\t[[maybe_unused]] RunnerContext " << inner << " = { nullptr, " << context << ".fA };\n";
+			emitBody(out, f.literalFunctions, inner, "", depth + 1, contexts);
+			out << indent << "}\n";
+			n += 1;
+		} else if (f.functionType == FUNCTION_DEFINITION) {
+			unsigned long long d = emitDefinition(f);
+			bool compiled = (!f.definitionInfo.memoized || f.definitionInfo.tailCallRecursive);
+			out << indent << "define(" << d << ", " << nameIndex(f.functionName) << ", "
+				<< (compiled ? "definition" + std::to_string(d) : "nullptr") << ", r, " << context << ".fA); //"
+				<< f.functionName << "\n";
+		} else if (f.functionType == DEFINED_FUNCTION) {
+			if (predefinedFunctions.isBuiltinFunction(f.functionName)) {
+				out << indent << "runBuiltin(" << builtinIndex(f.functionName) << ", r, &" << context << "); //" << comment(f.functionName) << "\n";
+			} else {
+				out << indent << "runDefined(" << nameIndex(f.functionName) << ", r, &" << context << "); //" << comment(f.functionName) << "\n";
+			}
+		} else {
+			out << indent << "r->getCurrentStack()->push(literals[" << literalIndex(f) << "]); //" << comment(charmFunctionToString(f)) << "\n";
+		}
+	}
+}
+
+unsigned long long Transpiler::emitDefinition(const CharmFunction& f) {
+	CharmFunction body = f;
+	body.functionType = LIST_FUNCTION;
+	definitions.push_back("definition(" + quote(f.functionName) + ", " + expression(body) + ".literalFunctions, " +
+		infoExpression(f.definitionInfo) + ")");
+	unsigned long long d = definitions.size() - 1;
+	//memoized definitions go through the runner's caches, unless they're a tail call loop (which skips them)
+	if (f.definitionInfo.memoized && !f.definitionInfo.tailCallRecursive) {
+		return d;
+	}
+	std::stringstream out;
+	unsigned int contexts = 0;
+	out << "//" << comment(f.functionName) << "\n";
+	out << "static void definition" << d << "(Runner* r, RunnerContext* caller) {\n";
+	out << "\tr->step();\n";
+	out << "\tRunner::CallFrame frame(r, &definitions[" << d << "].functionName.str());\n";
+	if (f.definitionInfo.checkedPopsCount > 0) {
+		out << "\tr->checkArguments(definitions[" << d << "]);\n";
+	}
+	if (f.definitionInfo.tailCallRecursive) {
+		//`f := ... f` runs its body forever, without the definition (like Runner::handleDefinedFunctions)
+		CHARM_LIST_TYPE loopBody = f.literalFunctions;
+		loopBody.pop_back();
+		out << "\t[[maybe_unused]] RunnerContext context = { nullptr, caller->fA };\n";
+		out << "\twhile (true) {\n";
+		out << "\t\tr->step();\n";
+		emitBody(out, loopBody, "context", "", 2, contexts);
+		out << "\t}\n";
+	} else {
+		out << "\t[[maybe_unused]] RunnerContext context = { &definitions[" << d << "], caller->fA };\n";
+		emitBody(out, f.literalFunctions, "context", f.functionName, 1, contexts);
+	}
+	out << "}\n\n";
+	functions << out.str();
+	return d;
+}
+
+void Transpiler::emitLine(std::ostream& out, const CHARM_LIST_TYPE& line) {
+	unsigned int contexts = 0;
+	out << "\t[[maybe_unused]] RunnerContext context = { nullptr, fA };\n";
+	emitBody(out, line, "context", "", 1, contexts);
+}
+
+void Transpiler::addPrelude(CHARM_LIST_TYPE parsedPrelude) {
+	emitLine(prelude, parsedPrelude);
+}
+
+void Transpiler::addLine(CHARM_LIST_TYPE parsedLine) {
+	if (parsedLine.size() == 0) {
+		return;
+	}
+	lineCount++;
+	program << "static void line" << lineCount << "(Runner* r, FunctionAnalyzer* fA) {\n";
+	emitLine(program, parsedLine);
+	program << "}\n\n";
+}
+
+std::string Transpiler::emit() {
+	std::stringstream out;
+	out << "//generated by `charm --emit-cpp` from " << sourceName << "\n";
+	out << "//build it against the charm runtime objects, see `make <program>.native`\n";
+	out << RUNTIME_SUPPORT << "\n";
+	out << functions.str();
+	out << "static void prelude(Runner* r, FunctionAnalyzer* fA) {\n" << prelude.str() << "}\n\n";
+	out << program.str();
+	out << "static void setup(Runner* r) {\n";
+	for (const std::string& literal : literals) {
+		out << "\tliterals.push_back(" << literal << ");\n";
+	}
+	for (const std::string& builtin : builtins) {
+		out << "\tbuiltins.push_back(&r->pF->cppFunctionNames.at(" << quote(builtin) << "));\n";
+	}
+	for (const std::string& name : names) {
+		out << "\tcalls.push_back({ charmCall(" << quote(name) << ") });\n";
+	}
+	out << "\tnatives.assign(" << names.size() << ", nullptr);\n";
+	for (const std::string& definition : definitions) {
+		out << "\tdefinitions.push_back(" << definition << ");\n";
+	}
+	out << "}\n\n";
+	out << "int main() {\n";
+	out << "\tRunner runner = Runner();\n";
+	out << "\tFunctionAnalyzer analyzer;\n";
+	out << "\tsetup(&runner);\n";
+	out << "\ttry {\n";
+	out << "\t\tprelude(&runner, &analyzer);\n";
+	out << "\t} catch (std::exception &e) {\n";
+	out << "\t\tprintf(\"Prelude.charm nonexistant or unopenable. This shouldn't ever happen! Please report it to the charm devs.\\n\");\n";
+	out << "\t\tprintf(\"Error: %s\\n\\n\", e.what());\n";
+	out << "\t\treturn -1;\n";
+	out << "\t}\n";
+	out << "\ttry {\n";
+	for (unsigned long long n = 1; n <= lineCount; n++) {
+		out << "\t\tline" << n << "(&runner, &analyzer);\n";
+	}
+	out << "\t} catch (std::exception &e) {\n";
+	out << "\t\tstandardOutput().flush();\n";
+	out << "\t\tprintf(\"%s nonexistant or unopenable.\\n\", " << quote(sourceName) << ");\n";
+	out << "\t\tprintf(\"Error: %s\\n\", e.what());\n";
+	out << "\t\treturn -1;\n";
+	out << "\t}\n";
+	out << "\tif (runner.getMemoCaches().size() > 0) {\n";
+	out << "\t\tstandardOutput().flush();\n";
+	out << "\t\tfprintf(stderr, \"Memoization statistics:\\n\");\n";
+	out << "\t\tfor (const auto& cache : runner.getMemoCaches()) {\n";
+	out << "\t\t\tfprintf(stderr, \"    %s: %llu hits, %llu misses, %llu evictions\\n\",\n";
+	out << "\t\t\t\tcache.first.c_str(), cache.second.hits, cache.second.misses, cache.second.evictions);\n";
+	out << "\t\t}\n";
+	out << "\t}\n";
+	out << "\treturn 0;\n";
+	out << "}\n";
+	return out.str();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+
+#include "ParserTypes.h"
+#include "PredefinedFunctions.h"
+
+//compiles a parsed program ahead of time into C++ (`charm --emit-cpp`), which gets built
+//against the runtime object files into a native executable (`make <program>.native`).
+//every definition becomes a C++ function that calls the builtins and the other definitions
+//directly, tail calls become loops, and `ifthen` and `i` on literal lists become plain
+//control flow. anything else still works, it's handed back to the Runner it links against
+//the values still live on the Runner's stacks and the builtins are still called through its
+//table, which is most of what's left of the time: it's about 2-3x faster than the interpreter
+class Transpiler {
+private:
+	//the input file, for the error messages
+	std::string sourceName;
+	//used to tell builtins from defined functions
+	PredefinedFunctions predefinedFunctions;
+	//what the generated setup() fills its tables with, in order
+	std::vector<std::string> literals;
+	std::vector<std::string> builtins;
+	std::unordered_map<std::string, unsigned long long> builtinIndices;
+	std::vector<std::string> names;
+	std::unordered_map<std::string, unsigned long long> nameIndices;
+	std::vector<std::string> definitions;
+	//the compiled definitions and top level lines
+	std::stringstream functions;
+	std::stringstream prelude;
+	std::stringstream program;
+	unsigned long long lineCount;
+
+	unsigned long long literalIndex(const CharmFunction& f);
+	unsigned long long builtinIndex(const std::string& fName);
+	unsigned long long nameIndex(const std::string& fName);
+	//compiles a definition into its own function, returns its index in the definitions table
+	unsigned long long emitDefinition(const CharmFunction& f);
+	//tailName is the definition whose tail calls `ifthen` turns into loops ("" if there isn't one)
+	void emitBody(std::ostream& out, const CHARM_LIST_TYPE& body, const std::string& context,
+		const std::string& tailName, unsigned int depth, unsigned int& contexts);
+	void emitIfthen(std::ostream& out, const CharmFunction& cond, const CharmFunction& truthy, const CharmFunction& falsy,
+		const std::string& context, const std::string& tailName, unsigned int depth, unsigned int& contexts);
+	void emitLine(std::ostream& out, const CHARM_LIST_TYPE& line);
+
+	//C++ expressions that build these at startup
+	static std::string expression(const CharmFunction& f);
+	static std::string infoExpression(const CharmFunctionDefinitionInfo& info);
+	static std::string quote(const std::string& s);
+public:
+	Transpiler(std::string sourceName);
+	//the parsed prelude, and then every parsed line of the program, as they would be run
+	void addPrelude(CHARM_LIST_TYPE parsedPrelude);
+	void addLine(CHARM_LIST_TYPE parsedLine);
+	std::string emit();
+};
@@ -0,0 +1,546 @@
+#include <algorithm>
+
+#include "TypeInference.h"
+#include "ParserTypes.h"
+#include "Stack.h"
+#include "Debug.h"
+
+//the arithmetic that has an unchecked version, for when its arguments are proven ints
+static const std::unordered_map<std::string, std::string> UNCHECKED_ARITHMETIC = {
+	{ "+", "%+" }, { "-", "%-" }, { "*", "%*" }
+};
+
+static CharmTypeSignature makeSignature(std::string name, std::vector<CharmTypes> pops, std::vector<CharmTypes> pushes) {
+	CharmTypeSignature s;
+	s.functionName = name;
+	s.pops = pops;
+	s.pushes = pushes;
+	return s;
+}
+
+const std::unordered_map<std::string, CharmTypeSignature>& TypeInference::builtinSignatures() {
+	//these say what the builtins in PredefinedFunctions.cpp actually do, quirks and all
+	//(insert doesn't check what it's inserting into)
+	static const std::unordered_map<std::string, CharmTypeSignature> signatures = []() {
+		const CharmTypes ANY = TYPESIG_ANY, LIST = TYPESIG_LIST, LISTSTRING = TYPESIG_LISTSTRING;
+		const CharmTypes STRING = TYPESIG_STRING, INT = TYPESIG_INT, MAP = TYPESIG_MAP;
+		std::vector<CharmTypeSignature> table = {
+			makeSignature("p", { ANY }, { }),
+			makeSignature("pstring", { STRING }, { }),
+			makeSignature("newline", { }, { }),
+			makeSignature("getline", { }, { STRING }),
+			makeSignature("type", { ANY }, { ANY, STRING }),
+			makeSignature("eq", { ANY, ANY }, { INT }),
+			makeSignature("dup", { ANY }, { ANY, ANY }),
+			makeSignature("pop", { ANY }, { }),
+			makeSignature("swap", { INT, INT }, { }),
+			makeSignature("len", { ANY }, { ANY, INT }),
+			makeSignature("at", { LISTSTRING, INT }, { LISTSTRING, LISTSTRING }),
+			makeSignature("insert", { ANY, ANY, INT }, { ANY }),
+			makeSignature("concat", { LISTSTRING, LISTSTRING }, { LISTSTRING }),
+			makeSignature("split", { LISTSTRING, INT }, { LISTSTRING, LISTSTRING }),
+			makeSignature("tostring", { ANY }, { STRING }),
+			makeSignature("char", { INT }, { STRING }),
+			makeSignature("ord", { STRING }, { INT }),
+			makeSignature("find", { STRING, STRING }, { STRING, INT }),
+			makeSignature("substring", { STRING, INT, INT }, { STRING, STRING }),
+			makeSignature("replace", { STRING, STRING, STRING }, { STRING }),
+			makeSignature("splitby", { STRING, STRING }, { LIST }),
+			makeSignature("join", { LIST, STRING }, { STRING }),
+			makeSignature("sort", { LIST }, { LIST }),
+			makeSignature("sortby", { LIST, LIST }, { LIST }),
+			makeSignature("mnew", { }, { MAP }),
+			makeSignature("mget", { MAP, ANY }, { MAP, ANY }),
+			makeSignature("mset", { MAP, ANY, ANY }, { MAP }),
+			makeSignature("mhas", { MAP, ANY }, { MAP, INT }),
+			makeSignature("mdel", { MAP, ANY }, { MAP }),
+			makeSignature("mkeys", { MAP }, { MAP, LIST }),
+			makeSignature("q", { ANY }, { LIST }),
+			makeSignature("inline", { LIST }, { LIST }),
+			makeSignature("xor", { INT, INT }, { INT }),
+			makeSignature("abs", { ANY }, { ANY }),
+			makeSignature("+", { INT, INT }, { INT }),
+			makeSignature("-", { INT, INT }, { INT }),
+			makeSignature("/", { INT, INT }, { INT, INT }),
+			makeSignature("*", { INT, INT }, { INT }),
+			makeSignature("toint", { ANY }, { ANY }),
+			makeSignature("createstack", { INT, ANY }, { }),
+			makeSignature("getstack", { }, { ANY }),
+			makeSignature("switchstack", { ANY }, { }),
+			makeSignature("getref", { ANY }, { ANY }),
+			makeSignature("setref", { ANY, ANY }, { })
+		};
+		std::unordered_map<std::string, CharmTypeSignature> out;
+		for (const CharmTypeSignature& s : table) {
+			out[s.functionName] = s;
+		}
+		return out;
+	}();
+	return signatures;
+}
+
+bool TypeInference::meet(CharmTypes a, CharmTypes b, CharmTypes& out) {
+	//the type that's both a and b, if there is one
+	if (a == b || b == TYPESIG_ANY) {
+		out = a;
+	} else if (a == TYPESIG_ANY) {
+		out = b;
+	} else if (a == TYPESIG_LISTSTRING && (b == TYPESIG_LIST || b == TYPESIG_STRING)) {
+		out = b;
+	} else if (b == TYPESIG_LISTSTRING && (a == TYPESIG_LIST || a == TYPESIG_STRING)) {
+		out = a;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+CharmTypes TypeInference::join(CharmTypes a, CharmTypes b) {
+	//the type that's either a or b
+	if (a == b) return a;
+	CharmTypes m;
+	bool aTraversable = meet(a, TYPESIG_LISTSTRING, m);
+	bool bTraversable = meet(b, TYPESIG_LISTSTRING, m);
+	if (a != TYPESIG_ANY && b != TYPESIG_ANY && aTraversable && bTraversable) return TYPESIG_LISTSTRING;
+	return TYPESIG_ANY;
+}
+
+bool TypeInference::hasType(const CharmFunction& f, CharmTypes t) {
+	switch (t) {
+		case TYPESIG_ANY: return true;
+		case TYPESIG_LIST: return f.functionType == LIST_FUNCTION;
+		case TYPESIG_LISTSTRING: return f.functionType == LIST_FUNCTION || f.functionType == STRING_FUNCTION;
+		case TYPESIG_STRING: return f.functionType == STRING_FUNCTION;
+		case TYPESIG_INT: return Stack::isInt(f);
+		case TYPESIG_FLOAT: return Stack::isFloat(f);
+		case TYPESIG_MAP: return f.functionType == MAP_FUNCTION;
+	}
+	return false;
+}
+
+std::string TypeInference::typeName(CharmTypes t) {
+	switch (t) {
+		case TYPESIG_ANY: return "any";
+		case TYPESIG_LIST: return "list";
+		case TYPESIG_LISTSTRING: return "list/string";
+		case TYPESIG_STRING: return "string";
+		case TYPESIG_INT: return "int";
+		case TYPESIG_FLOAT: return "float";
+		case TYPESIG_MAP: return "map";
+	}
+	return "any";
+}
+
+bool TypeInference::sameSignature(const CharmTypeSignature& a, const CharmTypeSignature& b) {
+	return (a.pops == b.pops) && (a.pushes == b.pushes);
+}
+
+//shuffles deeper than this aren't followed
+static const unsigned long long MAX_SHUFFLE_DEPTH = 1024;
+
+static CharmTypes literalType(const CharmFunction& f) {
+	if (f.functionType == LIST_FUNCTION) return TYPESIG_LIST;
+	if (f.functionType == STRING_FUNCTION) return TYPESIG_STRING;
+	if (f.functionType == MAP_FUNCTION) return TYPESIG_MAP;
+	if (Stack::isInt(f)) return TYPESIG_INT;
+	return TYPESIG_FLOAT;
+}
+
+TypeInference::TypeInference(std::string selfName, SignatureLookup lookup) {
+	TypeInference::selfName = selfName;
+	TypeInference::lookup = lookup;
+	selfSignature = nullptr;
+	seeded = false;
+	result = nullptr;
+}
+
+void TypeInference::giveUp(State& s) {
+	s.known = false;
+}
+
+void TypeInference::mismatch(State& s, std::string message) {
+	if (result->mismatch == "") {
+		result->mismatch = message;
+	}
+	s.known = false;
+}
+
+void TypeInference::need(State& s, unsigned long long n) {
+	//anything under what the definition has seen so far is one of its inputs
+	while (s.values.size() < n) {
+		AbstractValue input;
+		input.type = TYPESIG_ANY;
+		input.proven = false;
+		input.input = s.inputs.size();
+		input.literal = nullptr;
+		s.values.insert(s.values.begin(), input);
+		s.inputs.push_back(TYPESIG_ANY);
+	}
+}
+
+AbstractValue& TypeInference::at(State& s, unsigned long long depth) {
+	need(s, depth + 1);
+	return s.values[s.values.size() - 1 - depth];
+}
+
+bool TypeInference::require(State& s, unsigned long long depth, CharmTypes t, const std::string& fName) {
+	AbstractValue& v = at(s, depth);
+	CharmTypes narrowed;
+	if (!meet(v.type, t, narrowed)) {
+		mismatch(s, "`" + fName + "` needs " + typeName(t) + ", but gets " + typeName(v.type) + ".");
+		return false;
+	}
+	if (narrowed != v.type) {
+		//the code expects more than we know, which doesn't prove anything
+		//(the builtin will check it), but says more about the inputs
+		if (v.input >= 0) {
+			long long input = v.input;
+			meet(s.inputs[input], t, s.inputs[input]);
+			for (AbstractValue& copy : s.values) {
+				if (copy.input == input) {
+					meet(copy.type, t, copy.type);
+					copy.proven = false;
+				}
+			}
+		} else {
+			v.type = narrowed;
+			v.proven = false;
+		}
+	}
+	return true;
+}
+
+AbstractValue TypeInference::pop(State& s) {
+	need(s, 1);
+	AbstractValue v = s.values.back();
+	s.values.pop_back();
+	return v;
+}
+
+void TypeInference::push(State& s, CharmTypes t, bool proven) {
+	AbstractValue v;
+	v.type = t;
+	v.proven = proven;
+	v.input = -1;
+	v.literal = nullptr;
+	s.values.push_back(v);
+}
+
+bool TypeInference::literalIndex(State& s, unsigned long long depth, unsigned long long& index) {
+	//stack shuffles only have a known effect if their indices are literals
+	AbstractValue& v = at(s, depth);
+	if (v.literal == nullptr || !Stack::isInt(*v.literal) || v.literal->numberValue.integerValue < 0) {
+		return false;
+	}
+	if ((unsigned long long)v.literal->numberValue.integerValue > MAX_SHUFFLE_DEPTH) {
+		return false;
+	}
+	index = v.literal->numberValue.integerValue;
+	return true;
+}
+
+bool TypeInference::isInitial(const State& s) {
+	if (s.values.size() != initial.values.size()) return false;
+	for (unsigned long long n = 0; n < s.values.size(); n++) {
+		const AbstractValue& a = s.values[n];
+		const AbstractValue& b = initial.values[n];
+		if (a.input != b.input || a.type != b.type || a.proven != b.proven) return false;
+	}
+	return true;
+}
+
+TypeInference::State TypeInference::join(State a, State b) {
+	if (!a.known || !b.known) {
+		//a branch that only doesn't have a known effect because it calls the definition
+		//itself goes with the other branch, which would be the recursion's base case
+		if (a.known && b.selfUnknown) return a;
+		if (b.known && a.selfUnknown) return b;
+		a.known = false;
+		a.selfUnknown = a.selfUnknown || b.selfUnknown;
+		return a;
+	}
+	//line up the inputs the branches took...
+	unsigned long long inputs = std::max(a.inputs.size(), b.inputs.size());
+	need(a, a.values.size() + (inputs - a.inputs.size()));
+	need(b, b.values.size() + (inputs - b.inputs.size()));
+	//...and then they have to leave the same amount on the stack
+	if (a.values.size() != b.values.size()) {
+		giveUp(a);
+		return a;
+	}
+	for (unsigned long long n = 0; n < inputs; n++) {
+		a.inputs[n] = join(a.inputs[n], b.inputs[n]);
+	}
+	for (unsigned long long n = 0; n < a.values.size(); n++) {
+		AbstractValue& av = a.values[n];
+		const AbstractValue& bv = b.values[n];
+		av.proven = av.proven && bv.proven;
+		av.type = join(av.type, bv.type);
+		if (av.input != bv.input) av.input = -1;
+		if (av.literal != bv.literal) av.literal = nullptr;
+	}
+	return a;
+}
+
+void TypeInference::runCall(State& s, const std::string& fName, const CharmTypeSignature& signature, bool provenOutputs, bool isSelf) {
+	bool argumentsProven = true;
+	for (unsigned long long n = 0; n < signature.pops.size(); n++) {
+		CharmTypes t = signature.pops[signature.pops.size() - 1 - n];
+		if (!require(s, n, t, fName)) return;
+		const AbstractValue& v = at(s, n);
+		CharmTypes narrowed;
+		argumentsProven = argumentsProven && v.proven && meet(v.type, t, narrowed) && (narrowed == v.type);
+	}
+	if (isSelf && !argumentsProven) {
+		result->unprovenSelfCalls = true;
+	}
+	for (unsigned long long n = 0; n < signature.pops.size(); n++) {
+		pop(s);
+	}
+	for (CharmTypes t : signature.pushes) {
+		push(s, t, provenOutputs && argumentsProven);
+	}
+}
+
+void TypeInference::runIfthen(State& s) {
+	CharmFunction* quotations[3];
+	for (unsigned long long n = 0; n < 3; n++) {
+		AbstractValue& v = at(s, 2 - n);
+		if (v.literal == nullptr || v.literal->functionType != LIST_FUNCTION) {
+			giveUp(s);
+			return;
+		}
+		quotations[n] = v.literal;
+	}
+	pop(s); pop(s); pop(s);
+	CharmFunction* cond = quotations[0];
+	CharmFunction* truthy = quotations[1];
+	CharmFunction* falsy = quotations[2];
+	auto endsWithSelf = [this](CharmFunction* q) {
+		return q->literalFunctions.size() > 0 && q->literalFunctions.back().functionType == DEFINED_FUNCTION &&
+			q->literalFunctions.back().functionName == selfName;
+	};
+	if ((endsWithSelf(truthy) || endsWithSelf(falsy)) && !isInitial(s)) {
+		//this becomes a loop (see ifthen in PredefinedFunctions.cpp), that goes around without
+		//running what came before it in the definition, so none of that can be relied on
+		for (AbstractValue& v : s.values) {
+			v.proven = false;
+			v.literal = nullptr;
+		}
+	}
+	run(s, cond->literalFunctions);
+	if (!s.known) return;
+	pop(s);
+	State t = s;
+	run(t, truthy->literalFunctions);
+	State f = s;
+	run(f, falsy->literalFunctions);
+	s = join(t, f);
+}
+
+void TypeInference::runBuiltin(State& s, CharmFunction& f) {
+	const std::string& fName = f.functionName;
+	if (fName == "i") {
+		AbstractValue& v = at(s, 0);
+		if (v.literal == nullptr || v.literal->functionType != LIST_FUNCTION) {
+			giveUp(s);
+			return;
+		}
+		CharmFunction* list = v.literal;
+		pop(s);
+		run(s, list->literalFunctions);
+	} else if (fName == "ifthen") {
+		runIfthen(s);
+	} else if (fName == "dup") {
+		AbstractValue v = at(s, 0);
+		s.values.push_back(v);
+	} else if (fName == "swap" || fName == "%flip" || fName == "%swapnth") {
+		unsigned long long i = 0, j = 1;
+		if (fName == "swap") {
+			if (!literalIndex(s, 0, i) || !literalIndex(s, 1, j)) {
+				giveUp(s);
+				return;
+			}
+			pop(s); pop(s);
+		} else if (fName == "%swapnth") {
+			if (!literalIndex(s, 0, i)) {
+				giveUp(s);
+				return;
+			}
+			pop(s);
+			j = i + 1;
+		}
+		//(make room first, so that neither reference moves)
+		need(s, std::max(i, j) + 1);
+		std::swap(at(s, i), at(s, j));
+	} else if (fName == "%copyfrom" || fName == "%dupcopyfrom") {
+		unsigned long long index;
+		if (!literalIndex(s, 0, index)) {
+			giveUp(s);
+			return;
+		}
+		pop(s);
+		if (fName == "%dupcopyfrom") {
+			AbstractValue v = at(s, 0);
+			s.values.push_back(v);
+		}
+		AbstractValue v = at(s, index);
+		s.values.push_back(v);
+	} else if (fName == "%addunder") {
+		if (!require(s, 0, TYPESIG_INT, fName) || !require(s, 2, TYPESIG_INT, fName)) return;
+		AbstractValue n = pop(s);
+		AbstractValue& under = at(s, 1);
+		under.proven = under.proven && n.proven;
+		under.input = -1;
+		under.literal = nullptr;
+	} else if (fName == "%swap12concat") {
+		need(s, 3);
+		std::swap(at(s, 1), at(s, 2));
+		CharmFunction concat = f;
+		concat.functionName = "concat";
+		runBuiltin(s, concat);
+	} else if (fName == "%put") {
+		at(s, 0);
+	} else if (fName == "type" || fName == "len") {
+		at(s, 0);
+		push(s, (fName == "type") ? TYPESIG_STRING : TYPESIG_INT, true);
+	} else if (fName == "at" || fName == "split") {
+		if (!require(s, 0, TYPESIG_INT, fName) || !require(s, 1, TYPESIG_LISTSTRING, fName)) return;
+		pop(s);
+		AbstractValue traversable = pop(s);
+		//at gives back what it indexed and what it found there, split gives back two halves
+		if (fName == "at") {
+			s.values.push_back(traversable);
+		} else {
+			push(s, traversable.type, traversable.proven);
+		}
+		push(s, traversable.type, traversable.proven);
+	} else if (fName == "insert") {
+		if (!require(s, 0, TYPESIG_INT, fName)) return;
+		pop(s); pop(s);
+		AbstractValue target = pop(s);
+		push(s, target.type, target.proven);
+	} else if (fName == "concat") {
+		CharmTypes both;
+		if (!require(s, 0, TYPESIG_LISTSTRING, fName) || !require(s, 1, TYPESIG_LISTSTRING, fName)) return;
+		if (!meet(at(s, 0).type, at(s, 1).type, both)) {
+			mismatch(s, "`concat` needs two lists or two strings, but gets " + typeName(at(s, 1).type) + " and " + typeName(at(s, 0).type) + ".");
+			return;
+		}
+		if (!require(s, 0, both, fName) || !require(s, 1, both, fName)) return;
+		AbstractValue a = pop(s);
+		AbstractValue b = pop(s);
+		push(s, both, a.proven && b.proven);
+	} else if (fName == "switchstack") {
+		//everything after this happens on another stack
+		giveUp(s);
+	} else {
+		std::string checkedName = fName;
+		for (const auto& unchecked : UNCHECKED_ARITHMETIC) {
+			if (unchecked.second == fName) checkedName = unchecked.first;
+		}
+		auto sigIter = builtinSignatures().find(checkedName);
+		if (sigIter == builtinSignatures().end()) {
+			giveUp(s);
+			return;
+		}
+		if (UNCHECKED_ARITHMETIC.find(fName) != UNCHECKED_ARITHMETIC.end()) {
+			bool proven = at(s, 0).proven && at(s, 0).type == TYPESIG_INT && at(s, 1).proven && at(s, 1).type == TYPESIG_INT;
+			auto siteIter = result->arithmetic.find(&f);
+			result->arithmetic[&f] = proven && (siteIter == result->arithmetic.end() || siteIter->second);
+		}
+		//the builtins always push what they say they do, or die trying
+		runCall(s, fName, sigIter->second, true, false);
+		for (unsigned long long n = 0; n < sigIter->second.pushes.size(); n++) {
+			at(s, n).proven = true;
+		}
+	}
+}
+
+void TypeInference::run(State& s, CHARM_LIST_TYPE& body) {
+	for (CharmFunction& f : body) {
+		if (!s.known) return;
+		if (f.functionType == NUMBER_FUNCTION || f.functionType == STRING_FUNCTION || f.functionType == LIST_FUNCTION) {
+			push(s, literalType(f), true);
+			s.values.back().literal = &f;
+		} else if (f.functionType == FUNCTION_DEFINITION) {
+			giveUp(s);
+		} else if (f.functionName == selfName) {
+			if (selfSignature == nullptr) {
+				result->unresolvedSelfCalls = true;
+				giveUp(s);
+				s.selfUnknown = true;
+			} else {
+				//the definition's own outputs are proven by induction: if its arguments are
+				//(and everything it returns turns out to be), then so is what it returns here
+				runCall(s, f.functionName, *selfSignature, seeded, true);
+			}
+		} else {
+			CharmTypeSignature signature;
+			bool proven = false;
+			if (lookup(f.functionName, signature, proven)) {
+				runCall(s, f.functionName, signature, proven, false);
+			} else {
+				runBuiltin(s, f);
+			}
+		}
+	}
+}
+
+InferenceResult TypeInference::infer(CHARM_LIST_TYPE& body, const CharmTypeSignature* selfSignature, bool seeded) {
+	InferenceResult out;
+	out.known = false;
+	out.unresolvedSelfCalls = false;
+	out.unprovenSelfCalls = false;
+	result = &out;
+	TypeInference::selfSignature = selfSignature;
+	TypeInference::seeded = seeded && (selfSignature != nullptr);
+	State s;
+	s.known = true;
+	s.selfUnknown = false;
+	if (TypeInference::seeded) {
+		//these get checked when the definition is called
+		need(s, selfSignature->pops.size());
+		for (unsigned long long n = 0; n < s.values.size(); n++) {
+			s.values[n].type = selfSignature->pops[n];
+			s.values[n].proven = true;
+			s.inputs[s.values[n].input] = selfSignature->pops[n];
+		}
+	}
+	initial = s;
+	run(s, body);
+	out.known = s.known;
+	if (s.known) {
+		out.effect.functionName = selfName;
+		out.effect.pops.assign(s.inputs.rbegin(), s.inputs.rend());
+		for (const AbstractValue& v : s.values) {
+			out.effect.pushes.push_back(v.type);
+			out.provenPushes.push_back(v.proven);
+		}
+	}
+	result = nullptr;
+	return out;
+}
+
+unsigned long long TypeInference::specialize(const InferenceResult& result) {
+	unsigned long long specialized = 0;
+	for (const auto& site : result.arithmetic) {
+		if (site.second) {
+			site.first->functionName = UNCHECKED_ARITHMETIC.at(site.first->functionName);
+			specialized++;
+		}
+	}
+	return specialized;
+}
+
+void TypeInference::despecialize(CHARM_LIST_TYPE& body) {
+	for (CharmFunction& f : body) {
+		if (f.functionType == LIST_FUNCTION) {
+			despecialize(f.literalFunctions);
+		} else if (f.functionType == DEFINED_FUNCTION) {
+			for (const auto& unchecked : UNCHECKED_ARITHMETIC) {
+				if (unchecked.second == f.functionName) f.functionName = unchecked.first;
+			}
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include "ParserTypes.h"
+
+//what's known about a value on the stack while following a definition
+struct AbstractValue {
+	CharmTypes type;
+	//proven values definitely have this type. unproven ones only have the
+	//type the code expects them to, so the builtins still have to check them
+	bool proven;
+	//which of the definition's inputs this is a copy of (-1 if the definition made it)
+	long long input;
+	//the literal this came from, if it's known exactly (lists to run, indices to swap)
+	CharmFunction* literal;
+};
+
+struct InferenceResult {
+	//whether the whole definition could be followed. if not, effect doesn't mean anything
+	bool known;
+	//the stack effect, pops and pushes deepest first
+	CharmTypeSignature effect;
+	std::vector<bool> provenPushes;
+	//calls to the definition itself that had no signature to go off of
+	bool unresolvedSelfCalls;
+	//calls to the definition itself whose arguments weren't all proven
+	bool unprovenSelfCalls;
+	//the first definite type error, if there was one
+	std::string mismatch;
+	//checked arithmetic, and whether its arguments were proven ints every time it was reached
+	std::unordered_map<CharmFunction*, bool> arithmetic;
+};
+
+//symbolically runs definitions on a stack of types, to check and infer type signatures
+//and to find arithmetic that can skip its type checks (the unchecked `%+` builtins)
+class TypeInference {
+public:
+	//looks up the signature of a defined function. proven is set if
+	//its outputs definitely have those types when its inputs do
+	typedef std::function<bool(const std::string&, CharmTypeSignature&, bool&)> SignatureLookup;
+private:
+	struct State {
+		//the stack, from the deepest input the definition touches up
+		std::vector<AbstractValue> values;
+		//the types the definition expects its inputs to have, top of the stack first
+		std::vector<CharmTypes> inputs;
+		bool known;
+		//not known because of a call to the definition itself that had no signature
+		bool selfUnknown;
+	};
+	std::string selfName;
+	SignatureLookup lookup;
+	const CharmTypeSignature* selfSignature;
+	bool seeded;
+	State initial;
+	InferenceResult* result;
+
+	void giveUp(State& s);
+	void mismatch(State& s, std::string message);
+	void need(State& s, unsigned long long n);
+	AbstractValue& at(State& s, unsigned long long depth);
+	bool require(State& s, unsigned long long depth, CharmTypes t, const std::string& fName);
+	AbstractValue pop(State& s);
+	void push(State& s, CharmTypes t, bool proven);
+	bool literalIndex(State& s, unsigned long long depth, unsigned long long& index);
+	bool isInitial(const State& s);
+	State join(State a, State b);
+
+	void run(State& s, CHARM_LIST_TYPE& body);
+	void runBuiltin(State& s, CharmFunction& f);
+	void runCall(State& s, const std::string& fName, const CharmTypeSignature& signature, bool provenOutputs, bool isSelf);
+	void runIfthen(State& s);
+public:
+	TypeInference(std::string selfName, SignatureLookup lookup);
+	//follow body, a definition of selfName. selfSignature is what calls to itself do
+	//(if it's known). if seeded, the definition's inputs are proven to be what
+	//selfSignature says (because they get checked when it's called)
+	InferenceResult infer(CHARM_LIST_TYPE& body, const CharmTypeSignature* selfSignature, bool seeded);
+	//replace the arithmetic that was always proven with the unchecked builtins
+	static unsigned long long specialize(const InferenceResult& result);
+	//and back again, for bodies that get inlined somewhere the proof doesn't hold
+	static void despecialize(CHARM_LIST_TYPE& body);
+
+	//the stack effects of the builtins (pops and pushes deepest first). the control
+	//flow builtins (`i`, `ifthen`) aren't in here, those are followed instead
+	static const std::unordered_map<std::string, CharmTypeSignature>& builtinSignatures();
+	static bool meet(CharmTypes a, CharmTypes b, CharmTypes& out);
+	static CharmTypes join(CharmTypes a, CharmTypes b);
+	static bool hasType(const CharmFunction& f, CharmTypes t);
+	static std::string typeName(CharmTypes t);
+	static bool sameSignature(const CharmTypeSignature& a, const CharmTypeSignature& b);
+};
@@ -7,21 +7,35 @@
 
 #include "gui.h"
 #include "Debug.h"
+#include "Error.h"
 #include "PredefinedFunctions.h"
 
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <ncurses.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 // constants
 #define CONTROL_C 3
 #define CONTROL_L 12
 
 #define STACK_LEFT_MARGIN 4
 
+// how long a command gets to finish before the progress is shown, how often the keyboard is checked
+// while it runs, and how often it takes a snapshot of the stack to show
+#define QUICK_RUN_MILLISECONDS 100
+#define POLL_MILLISECONDS 50
+#define SNAPSHOT_MILLISECONDS 100
+
 // global variables
 Parser* parser;
 Runner* runner;
+static ExecutionLimits limits;
 
 static WINDOW* stack_win;
 static WINDOW* readline_win;
@@ -29,9 +43,43 @@ static WINDOW* readline_win;
 static int last_char;
 static bool have_input;
 
+// (written by the worker thread while a command runs)
+static std::mutex output_mutex;
 static bool had_output = false;
 static std::string accumulated_output;
 
+// commands run on a worker thread, so that the UI can show how they're going and stop them.
+// while one runs, the worker is the only one that touches the runner (and the parser), except to
+// cancel it, and the UI thread is the only one that touches curses and readline
+static std::mutex run_mutex;
+static std::condition_variable run_done;
+static bool running = false;
+
+// a line the worker is waiting for (from `getline`), read in by the UI thread
+static std::mutex input_mutex;
+static std::condition_variable input_ready;
+static bool input_requested = false;
+static bool input_cancelled = false;
+static std::string input_line;
+
+// the top of the stack as the worker last saw it. the worker only makes a new one once the UI
+// has taken the last one, so they're handed over without locking
+struct StackSnapshot {
+	unsigned long long steps;
+	std::vector<std::string> rows;
+};
+static std::atomic<StackSnapshot*> latest_snapshot(nullptr);
+static std::atomic<int> snapshot_rows(0);
+static std::atomic<int> snapshot_width(0);
+// (only used by the worker)
+static std::chrono::steady_clock::time_point next_snapshot;
+
+// what the stack window shows, so that only the rows that changed get written out again.
+// shown_rows[n] is the value n from the top (the row h-n-1), as it was last written
+static Stack* shown_stack = nullptr;
+static CharmFunction shown_stack_name;
+static std::vector<std::string> shown_rows;
+
 // private functions
 static void init_stack_win() {
 	int w, h;
@@ -41,27 +89,86 @@ static void init_stack_win() {
 		mvwprintw(stack_win, i, 0, "%d:", h-i-1);
 		wclrtoeol(stack_win);
 	}
+
+	// the values are all gone from the window, so they all get written next time
+	shown_stack = nullptr;
+	shown_rows.clear();
 }
 
-static void update_stack_win() {
-	int w, h;
-	getmaxyx(stack_win, h, w);
+// the value n from the top of stack, as much of it as fits in line
+static std::string stack_row(Stack* stack, unsigned long long n, std::vector<char>& line) {
+	if (n >= stack->size()) {
+		// under the bottom of the stack: left blank
+		return std::string();
+	}
+	charmFunctionToBuffer(stack->at(n), line.data(), line.size(), PREVIEW_LIMITS);
+	return std::string(line.data());
+}
 
-	int depth = runner->getCurrentStack()->stack.size();
+// writes out the rows that aren't what the window shows already
+static void draw_stack_rows(std::vector<std::string>& rows) {
+	int h = rows.size();
+	bool same_size = shown_rows.size() == rows.size();
+	for (int n = 0; n < h; n++) {
+		if (!same_size || rows[n] != shown_rows[n]) {
+			int i = h-n-1;
+			wmove(stack_win, i, STACK_LEFT_MARGIN);
+			wclrtoeol(stack_win);
+			mvwprintw(stack_win, i, STACK_LEFT_MARGIN, "%s", rows[n].c_str());
+		}
+	}
+	shown_rows.swap(rows);
 
-	for (int i = 0; i < h; i++) {
-		int stack_index = depth - (h-i-1) - 1;
+	wrefresh(stack_win);
+}
 
-		wmove(stack_win, i, STACK_LEFT_MARGIN);
-		wclrtoeol(stack_win);
+static void update_stack_win() {
+	int w, h;
+	getmaxyx(stack_win, h, w);
 
-		if (stack_index >= 0 && stack_index < (int) runner->getCurrentStack()->stack.size()) {
-			// TODO: handle long lines of input
-			mvwprintw(stack_win, i, STACK_LEFT_MARGIN, "%s", charmFunctionToString(runner->getCurrentStack()->stack[stack_index]).c_str());
+	Stack* stack = runner->getCurrentStack();
+	// (values that come up from under the bottom, or go down past it, are never moved)
+	long long depth = std::min<unsigned long long>(stack->size(), h);
+	// what's changed since the last time: under the top `modified` values, the stack
+	// is what was shown `shift` rows further up (or down), so those rows are just moved
+	bool same_stack = stack == shown_stack && stack->name == shown_stack_name && shown_rows.size() == (size_t)h;
+	unsigned long long modified = stack->getModifiedStackArea();
+	long long shift = stack->getStackShift();
+	// only as much as fits on a line gets written out (so big values aren't written out in full)
+	std::vector<char> line(std::max(w - STACK_LEFT_MARGIN, 0) + 1);
+
+	std::vector<std::string> rows(h);
+	for (int n = 0; n < h; n++) {
+		long long from = n - shift;
+		if (same_stack && (unsigned long long)n >= modified && n < depth && from >= 0 && from < depth) {
+			rows[n] = shown_rows[from];
+		} else {
+			rows[n] = stack_row(stack, n, line);
 		}
 	}
 
-	wrefresh(stack_win);
+	draw_stack_rows(rows);
+	shown_stack = stack;
+	shown_stack_name = stack->name;
+	stack->clearModifiedStackArea();
+}
+
+// the worker's Runner::progress: every so often, a snapshot of the top of the stack for the UI
+static void take_snapshot(Runner* r) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now < next_snapshot || latest_snapshot.load() != nullptr) {
+		return;
+	}
+	next_snapshot = now + std::chrono::milliseconds(SNAPSHOT_MILLISECONDS);
+
+	StackSnapshot* snapshot = new StackSnapshot();
+	snapshot->steps = r->getSteps();
+	Stack* stack = r->getCurrentStack();
+	std::vector<char> line(snapshot_width.load());
+	for (int n = 0; n < snapshot_rows.load(); n++) {
+		snapshot->rows.push_back(stack_row(stack, n, line));
+	}
+	latest_snapshot.store(snapshot);
 }
 
 static void display_error(const char* what) {
@@ -101,42 +208,168 @@ static void readline_redisplay() {
 	wmove(readline_win, 0, strlen(rl_display_prompt) + rl_point);
 }
 
-static void readline_callback_handler(char* line) {
-	add_history(line);
-	werase(readline_win);
+static void resize_gui() {
+	wresize(stack_win, LINES-1, COLS); mvwin(stack_win, 0, 0);
+	wresize(readline_win, 1, COLS); mvwin(readline_win, LINES-1, 0);
+}
 
-	try {
-		runner->run(parser->lex(std::string(line)));
+static void readline_callback_handler(char* line);
 
-		if (had_output) {
-			// display accumulated output
-			werase(stack_win);
-			mvwprintw(stack_win, 0, 0, "%s", accumulated_output.c_str());
-			wrefresh(stack_win);
+static char* get_input_line_result;
+static void get_input_line_callback_handler(char* line) {
+	get_input_line_result = line;
+}
+
+// reads a line for `getline`, on the UI thread. ^C stops the run instead (and leaves the line null)
+static char* read_input_line() {
+	rl_callback_handler_install("GETLINE> ", get_input_line_callback_handler);
+	get_input_line_result = nullptr;
 
-			werase(readline_win);
-			mvwprintw(readline_win, 0, 0, "Press any key to continue...");
-			wrefresh(readline_win);
+	while (get_input_line_result == nullptr) {
+		int c = wgetch(readline_win);
+		if (c == CONTROL_C) {
+			break;
+		}
+		if (c == ERR) {
+			continue;
+		}
+		last_char = c;
+		have_input = true;
+		rl_callback_read_char();
+	}
 
-			wgetch(readline_win);
-			init_stack_win(); update_stack_win();
+	rl_callback_handler_install("", readline_callback_handler);
+	return get_input_line_result;
+}
+
+// what the UI does while a command runs: shows the last snapshot, the steps and the time,
+// reads lines for `getline`, and cancels the run on ^C
+static void watch_run(std::chrono::steady_clock::time_point started) {
+	unsigned long long steps = 0;
+	int curs = curs_set(0);
+	wtimeout(readline_win, POLL_MILLISECONDS);
+
+	while (true) {
+		{
+			std::lock_guard<std::mutex> lock(run_mutex);
+			if (!running) break;
+		}
 
-			accumulated_output = ""; had_output = false;
+		bool wants_input;
+		{
+			std::lock_guard<std::mutex> lock(input_mutex);
+			wants_input = input_requested;
+		}
+		if (wants_input) {
+			curs_set(curs);
+			char* line = read_input_line();
+			curs_set(0);
+			{
+				std::lock_guard<std::mutex> lock(input_mutex);
+				input_cancelled = line == nullptr;
+				input_line = line ? line : "";
+				input_requested = false;
+			}
+			input_ready.notify_one();
+			continue;
+		}
+
+		StackSnapshot* snapshot = latest_snapshot.exchange(nullptr);
+		if (snapshot != nullptr) {
+			steps = snapshot->steps;
+			// (unless the window's changed size since it was taken)
+			if (snapshot->rows.size() == (size_t)getmaxy(stack_win)) {
+				draw_stack_rows(snapshot->rows);
+				// the rows don't match what the stack's tracked changes are from anymore
+				shown_stack = nullptr;
+			}
+			delete snapshot;
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+		werase(readline_win);
+		mvwprintw(readline_win, 0, 0, "Running: %llu steps, %.1fs (^C to stop)", steps, seconds);
+		wrefresh(readline_win);
+
+		int c = wgetch(readline_win);
+		if (c == CONTROL_C) {
+			runner->cancel();
+		} else if (c == KEY_RESIZE) {
+			resize_gui();
+			werase(stack_win);
+			init_stack_win();
+			snapshot_rows.store(getmaxy(stack_win));
+			snapshot_width.store(std::max(getmaxx(stack_win) - STACK_LEFT_MARGIN, 0) + 1);
 		}
-	} catch (const std::runtime_error& e) {
-		display_error(e.what());
 	}
 
-	update_stack_win();
+	wtimeout(readline_win, -1);
+	curs_set(curs);
+	werase(readline_win); wrefresh(readline_win);
 }
 
-static char* get_input_line_result;
-static void get_input_line_callback_handler(char* line) {
-	get_input_line_result = line;
+static void readline_callback_handler(char* line) {
+	add_history(line);
+	werase(readline_win);
+
+	// start the command on the worker thread
+	std::string command(line);
+	std::string error;
+	snapshot_rows.store(getmaxy(stack_win));
+	snapshot_width.store(std::max(getmaxx(stack_win) - STACK_LEFT_MARGIN, 0) + 1);
+	next_snapshot = std::chrono::steady_clock::now() + std::chrono::milliseconds(QUICK_RUN_MILLISECONDS);
+	runner->setLimits(limits);
+	runner->progress = take_snapshot;
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	running = true;
+	std::thread worker([&command, &error]() {
+		try {
+			runner->run(parser->lex(command));
+		} catch (const std::runtime_error& e) {
+			error = e.what();
+		}
+		{
+			std::lock_guard<std::mutex> lock(run_mutex);
+			running = false;
+		}
+		run_done.notify_one();
+	});
+
+	// most commands are done before there's anything to show
+	bool finished;
+	{
+		std::unique_lock<std::mutex> lock(run_mutex);
+		finished = run_done.wait_for(lock, std::chrono::milliseconds(QUICK_RUN_MILLISECONDS), [] { return !running; });
+	}
+	if (!finished) {
+		watch_run(started);
+	}
+	worker.join();
+	runner->progress = nullptr;
+	delete latest_snapshot.exchange(nullptr);
+
+	if (!error.empty()) {
+		display_error(error.c_str());
+	} else if (had_output) {
+		// display accumulated output
+		werase(stack_win);
+		mvwprintw(stack_win, 0, 0, "%s", accumulated_output.c_str());
+		wrefresh(stack_win);
+
+		werase(readline_win);
+		mvwprintw(readline_win, 0, 0, "Press any key to continue...");
+		wrefresh(readline_win);
+
+		wgetch(readline_win);
+		init_stack_win(); update_stack_win();
+	}
+	accumulated_output = ""; had_output = false;
+
+	update_stack_win();
 }
 
 static void set_prompt() {
-	std::string stack_name = charmFunctionToString(runner->getCurrentStack()->name);
+	std::string stack_name = charmFunctionToString(runner->getCurrentStack()->name, PREVIEW_LIMITS);
 	std::string prompt = stack_name + "> ";
 	rl_set_prompt(prompt.c_str());
 
@@ -148,32 +381,44 @@ static void exit_gui(int rc) {
 	exit(rc);
 }
 
+// the names that finish what's being typed, looked up when readline starts asking for them
+static std::vector<std::string> completions;
+static size_t next_completion;
+
 static char* function_name_generator(const char* line, int state) {
-	// TODO: we currently only pick the first result we find. But multimatches break Curses.
-    if (state || strlen(line) == 0) return nullptr;
+	if (state == 0) {
+		completions.clear();
+		next_completion = 0;
+		if (strlen(line) > 0) {
+			completions = runner->completeName(line);
+		}
+	}
 
-    int len = strlen(line);
+	if (next_completion >= completions.size()) return nullptr;
+	return strdup(completions[next_completion++].c_str());
+}
 
-    // match with functions defined in this runner
-    auto fds = runner->getFunctionDefinitions();
-	for (const auto& fd : fds) {
-		const char* name = fd.functionName.c_str();
-		if (strncmp(name, line, len) == 0) {
-			return strdup(name);
-		}
+// readline would print the list of matches straight to the terminal, so it goes in the stack window
+static void display_completions(char** matches, int num_matches, int max_length) {
+	int curs = curs_set(0);
+
+	werase(stack_win);
+	wmove(stack_win, 0, 0);
+	// (matches[0] is what they all start with)
+	for (int i = 1; i <= num_matches; i++) {
+		wprintw(stack_win, "%s  ", matches[i]);
 	}
+	wrefresh(stack_win);
 
-	// match predefined functions
-	auto predefs = runner->pF->cppFunctionNames;
-    for (const auto& entry : predefs) {
-		const char* name = entry.first.c_str();
-		if (strncmp(name, line, len) == 0) {
-			return strdup(name);
-		}
-    }
+	werase(readline_win);
+	mvwprintw(readline_win, 0, 0, "Press any key to continue...");
+	wrefresh(readline_win);
+
+	wgetch(readline_win);
+	init_stack_win(); update_stack_win();
 
-	// no matches; return null
-    return nullptr;
+	curs_set(curs);
+	readline_redisplay();
 }
 
 static char** function_name_completion(const char * line, int start, int end) {
@@ -183,27 +428,26 @@ static char** function_name_completion(const char * line, int start, int end) {
 
 // public interface
 void display_output(std::string output) {
+	std::lock_guard<std::mutex> lock(output_mutex);
 	had_output = true;
 	accumulated_output += output;
 }
 
 std::string get_input_line() {
-	rl_callback_handler_install("GETLINE> ", get_input_line_callback_handler);
-	get_input_line_result = nullptr;
-
-	while (get_input_line_result == nullptr) {
-    	last_char = wgetch(readline_win);
-    	have_input = true;
-    	rl_callback_read_char();
+	// (on the worker thread: the UI thread reads the line and hands it over)
+	std::unique_lock<std::mutex> lock(input_mutex);
+	input_requested = true;
+	input_ready.wait(lock, [] { return !input_requested; });
+	if (input_cancelled) {
+		runtime_die("Cancelled.");
 	}
-
-	rl_callback_handler_install("", readline_callback_handler);
-	return std::string(get_input_line_result);
+	return input_line;
 }
 
-void charm_gui_init(Parser _parser, Runner _runner) {
+void charm_gui_init(Parser _parser, Runner _runner, ExecutionLimits _limits) {
 	parser = &_parser;
 	runner = &_runner;
+	limits = _limits;
 
 	// initialize curses
 	initscr();
@@ -233,6 +477,7 @@ void charm_gui_init(Parser _parser, Runner _runner) {
     rl_input_available_hook = readline_input_available;
     rl_redisplay_function = readline_redisplay;
     rl_attempted_completion_function = function_name_completion;
+    rl_completion_display_matches_hook = display_completions;
     rl_callback_handler_install("", readline_callback_handler);
 
     // do the main GUI loop
@@ -248,8 +493,7 @@ void charm_gui_init(Parser _parser, Runner _runner) {
     		break;
     	case KEY_RESIZE:
     		// we got a SIGWINCH; resize the GUI
-    		wresize(stack_win, LINES-1, COLS); mvwin(stack_win, 0, 0);
-    		wresize(readline_win, 1, COLS); mvwin(readline_win, LINES-1, 0);
+    		resize_gui();
     		// no break on purpose, so we refresh the screen too
     	case CONTROL_L:
     		// ^L: refresh the screen
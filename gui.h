@@ -11,7 +11,8 @@
 #include "Parser.h"
 #include "Runner.h"
 
-void charm_gui_init(Parser parser, Runner runner);
+//limits apply to each command, like in the REPL
+void charm_gui_init(Parser parser, Runner runner, ExecutionLimits limits);
 void display_output(std::string output);
 std::string get_input_line();
 
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <string_view>
 #include <functional>
+#include <thread>
 
 #ifdef CHARM_GUI
 	#include "gui.h"
@@ -20,16 +21,25 @@
 
 #include "Parser.h"
 #include "Runner.h"
+#include "PredefinedFunctions.h"
+#include "Profiler.h"
+#include "Transpiler.h"
+#include "Server.h"
+#include "Batch.h"
+#include "Output.h"
+#include "CharmPool.h"
 #include "Debug.h"
 
 const std::string VERSION = "0.0.1";
 
 template<std::vector<std::string>* arg, std::string* flag, std::function<void()>* f>
 struct CommandLineLambda {
-	//returns whether or not the argument was called
+	//returns whether or not the argument was called (and takes it out of the
+	//arguments, so that it isn't mistaken for an input file)
 	static inline bool runArg() {
 		auto iter = std::find(arg->begin(), arg->end(), *flag);
 		if (iter != arg->end()) {
+			arg->erase(iter);
 			(*f)();
 			return true;
 		}
@@ -52,13 +62,36 @@ struct CommandLineOptional {
 			} else {
 				//if the argument is properly formed
 				(*var) = *(std::next(iter));
-				arg->erase(iter, std::next(iter));
+				arg->erase(iter, std::next(iter, 2));
 			}
 		}
 		return true;
 	}
 };
 
+#ifndef CHARM_GUI
+//tab completion in the REPL, from the names of the builtins and definitions
+static Runner* completionRunner;
+static std::vector<std::string> completions;
+static size_t nextCompletion;
+
+static char* completionGenerator(const char* text, int state) {
+	//(readline asks for the matches one at a time, starting from state 0)
+	if (state == 0) {
+		completions = completionRunner->completeName(text);
+		nextCompletion = 0;
+	}
+	if (nextCompletion >= completions.size()) {
+		return nullptr;
+	}
+	return strdup(completions[nextCompletion++].c_str());
+}
+
+static char** completeFunctionName(const char* text, int start, int end) {
+	rl_attempted_completion_over = 1;
+	return rl_completion_matches(text, completionGenerator);
+}
+#endif
 
 int main(int argc, char const *argv[]) {
 	Parser parser = Parser();
@@ -74,13 +107,29 @@ int main(int argc, char const *argv[]) {
 		puts("By @Aearnus");
 		puts("Usage:");
 		puts("    charm [flags] [input file]");
+		puts("    charm [flags] -j <count> <input files...>");
 		puts("Note:");
 		puts("    Calling charm without an input file starts a REPL in most situations.");
+		puts("    Calling charm with more than one input file (or with -j) runs them all as a batch, each on its own, and prints their output in order.");
 		puts("Flags:");
 		puts("    -h: Print this help message.");
 		puts("    -v: Print the version.");
 		puts("    -a <function name>: Analyze a function from the input file and print out information about it.");
 		puts("    -f <file path>: Load up a file to be used interactively in the REPL.");
+		puts("    -m: Memoize every pure recursive function that has a type signature.");
+		puts("    -p <file path>: Profile the input file, writing the most run sequences of functions (superinstruction candidates) and the most called functions to a file.");
+		puts("    -u <file path>: Use a profile written by -p to decide which functions are worth inlining.");
+		puts("    --alloc-stats: Print how many blocks the input file took from the allocation pool, and how many of those were reused.");
+		puts("    --max-steps <steps>: Stop with an error after running this many functions (or trips around a loop).");
+		puts("    --timeout <milliseconds>: Stop with an error after running for this long.");
+		puts("    --max-memory <megabytes>: Stop with an error once the input file has more than this allocated.");
+		puts("    --max-depth <calls>: Stop with an error when calls go this deep (definitions inside of definitions, and `i` and `ifthen`). Defaults to 2000, 0 means no limit.");
+		puts("    --emit-cpp <file path>: Compile the input file to C++ instead of running it. Build it with `make <input file>.native`.");
+		puts("    --serve <socket path>: Keep the prelude loaded and run the scripts sent by --client, each in a fresh runner. The limits apply to each script.");
+		puts("    -j <count>: How many scripts --serve (or a batch) runs at once. Defaults to the number of cores.");
+		puts("    --json: Print what each script in a batch did as a line of JSON.");
+		puts("    --sort-jobs <count>: How many threads sort and sortby split a big list between. Defaults to the number of cores.");
+		puts("    --client <socket path>: Run the input file on a charm started with --serve, instead of starting up here.");
 	};
 	CommandLineLambda<&args, &helpFlag, &helpF> helpArg;
 	if (helpArg.runArg()) {
@@ -96,6 +145,29 @@ int main(int argc, char const *argv[]) {
 		return 0;
 	}
 
+	static std::string memoizeFlag("-m");
+	static std::function<void()> memoizeF = [&parser]() {
+		parser.setMemoizeAll(true);
+	};
+	CommandLineLambda<&args, &memoizeFlag, &memoizeF> memoizeArg;
+	memoizeArg.runArg();
+
+	static bool allocStats = false;
+	static std::string allocStatsFlag("--alloc-stats");
+	static std::function<void()> allocStatsF = []() {
+		allocStats = true;
+	};
+	CommandLineLambda<&args, &allocStatsFlag, &allocStatsF> allocStatsArg;
+	allocStatsArg.runArg();
+
+	static bool json = false;
+	static std::string jsonFlag("--json");
+	static std::function<void()> jsonF = []() {
+		json = true;
+	};
+	CommandLineLambda<&args, &jsonFlag, &jsonF> jsonArg;
+	jsonArg.runArg();
+
 	static std::optional<std::string> analyzeFunctionOpt;
 	static std::string analyzeFunctionFlag("-a");
 	CommandLineOptional<&args, &analyzeFunctionFlag, &analyzeFunctionOpt> analyzeFunctionArg;
@@ -103,6 +175,26 @@ int main(int argc, char const *argv[]) {
 		return -1;
 	}
 
+	static std::optional<std::string> emitCppOpt;
+	static std::string emitCppFlag("--emit-cpp");
+	CommandLineOptional<&args, &emitCppFlag, &emitCppOpt> emitCppArg;
+	if (!emitCppArg.runArg()) {
+		return -1;
+	}
+
+	static std::optional<std::string> serveOpt;
+	static std::string serveFlag("--serve");
+	CommandLineOptional<&args, &serveFlag, &serveOpt> serveArg;
+	static std::optional<std::string> clientOpt;
+	static std::string clientFlag("--client");
+	CommandLineOptional<&args, &clientFlag, &clientOpt> clientArg;
+	static std::optional<std::string> jobsOpt;
+	static std::string jobsFlag("-j");
+	CommandLineOptional<&args, &jobsFlag, &jobsOpt> jobsArg;
+	if (!serveArg.runArg() || !clientArg.runArg() || !jobsArg.runArg()) {
+		return -1;
+	}
+
 	static std::optional<std::string> interactiveFileOpt;
 	static std::string interactiveFileFlag("-f");
 	CommandLineOptional<&args, &interactiveFileFlag, &interactiveFileOpt> interactiveFileArg;
@@ -110,34 +202,255 @@ int main(int argc, char const *argv[]) {
 		return -1;
 	}
 
+	static std::optional<std::string> profileFileOpt;
+	static std::string profileFileFlag("-p");
+	CommandLineOptional<&args, &profileFileFlag, &profileFileOpt> profileFileArg;
+	if (!profileFileArg.runArg()) {
+		return -1;
+	}
+	Profiler profiler;
+
+	static std::optional<std::string> useProfileOpt;
+	static std::string useProfileFlag("-u");
+	CommandLineOptional<&args, &useProfileFlag, &useProfileOpt> useProfileArg;
+	if (!useProfileArg.runArg()) {
+		return -1;
+	}
+	static std::optional<std::string> sortJobsOpt;
+	static std::string sortJobsFlag("--sort-jobs");
+	CommandLineOptional<&args, &sortJobsFlag, &sortJobsOpt> sortJobsArg;
+	if (!sortJobsArg.runArg()) {
+		return -1;
+	}
+	if (sortJobsOpt) {
+		try {
+			PredefinedFunctions::setSortJobs(std::max(1, std::stoi(*sortJobsOpt)));
+		} catch (std::exception &e) {
+			printf("Error: --sort-jobs takes a number.\n");
+			return -1;
+		}
+	}
+
+	if (useProfileOpt) {
+		try {
+			parser.useProfile(*useProfileOpt);
+		} catch (std::exception &e) {
+			printf("Error: %s\n", e.what());
+			return -1;
+		}
+	}
+
+	//limits on running the input file (or each line of the REPL)
+	ExecutionLimits limits;
+	static std::optional<std::string> maxStepsOpt;
+	static std::string maxStepsFlag("--max-steps");
+	CommandLineOptional<&args, &maxStepsFlag, &maxStepsOpt> maxStepsArg;
+	static std::optional<std::string> timeoutOpt;
+	static std::string timeoutFlag("--timeout");
+	CommandLineOptional<&args, &timeoutFlag, &timeoutOpt> timeoutArg;
+	static std::optional<std::string> maxMemoryOpt;
+	static std::string maxMemoryFlag("--max-memory");
+	CommandLineOptional<&args, &maxMemoryFlag, &maxMemoryOpt> maxMemoryArg;
+	static std::optional<std::string> maxDepthOpt;
+	static std::string maxDepthFlag("--max-depth");
+	CommandLineOptional<&args, &maxDepthFlag, &maxDepthOpt> maxDepthArg;
+	if (!maxStepsArg.runArg() || !timeoutArg.runArg() || !maxMemoryArg.runArg() || !maxDepthArg.runArg()) {
+		return -1;
+	}
+	try {
+		if (maxStepsOpt) {
+			limits.maxSteps = std::stoull(*maxStepsOpt);
+		}
+		if (timeoutOpt) {
+			limits.timeoutMilliseconds = std::stoull(*timeoutOpt);
+		}
+		if (maxMemoryOpt) {
+			limits.maxMemory = std::stoull(*maxMemoryOpt) * 1024 * 1024;
+		}
+		if (maxDepthOpt) {
+			limits.maxDepth = std::stoull(*maxDepthOpt);
+		}
+	} catch (std::exception &e) {
+		printf("Error: limits have to be whole numbers.\n");
+		return -1;
+	}
+
 	//parse input file
 	std::optional<std::string> optFileName;
 	if (args.size() > 0) {
 		optFileName = args.back();
 	}
 
+	//if we're analyzing a function, parse everything but don't run any of it
+	if (analyzeFunctionOpt) {
+		try {
+			parser.lex(prelude);
+			if (optFileName) {
+				std::string line;
+				std::ifstream inFile(*optFileName);
+				while (std::getline(inFile, line)) {
+					parser.lex(line);
+				}
+			}
+		} catch (std::exception &e) {
+			printf("Error: %s\n", e.what());
+			return -1;
+		}
+		printf("%s", parser.getFunctionAnalyzer()->analysisReport(*analyzeFunctionOpt).c_str());
+		return 0;
+	}
+
+	//if we're compiling, parse everything and write it out as C++ instead of running it
+	if (emitCppOpt) {
+		if (!optFileName) {
+			printf("No input file to compile.\n");
+			return -1;
+		}
+		try {
+			Transpiler transpiler(*optFileName);
+			transpiler.addPrelude(parser.lex(prelude).first);
+			std::string line;
+			std::ifstream inFile(*optFileName);
+			while (std::getline(inFile, line)) {
+				transpiler.addLine(parser.lex(line).first);
+			}
+			std::ofstream outFile(*emitCppOpt);
+			outFile << transpiler.emit();
+			if (!outFile) {
+				printf("Error: couldn't write to %s\n", (*emitCppOpt).c_str());
+				return -1;
+			}
+		} catch (std::exception &e) {
+			//(the same as running the file would say)
+			printf("%s nonexistant or unopenable.\n", (*optFileName).c_str());
+			printf("Error: %s\n", e.what());
+			return -1;
+		}
+		return 0;
+	}
+
+	//if there's a server, it does the running
+	if (clientOpt) {
+		if (!optFileName) {
+			printf("No input file to send.\n");
+			return -1;
+		}
+		return Server::runClient(*clientOpt, *optFileName);
+	}
+
+	//if we're serving, load the prelude once and copy it for each script that comes in
+	if (serveOpt) {
+		unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+		try {
+			if (jobsOpt) {
+				workers = std::max(1, std::stoi(*jobsOpt));
+			}
+		} catch (std::exception &e) {
+			printf("Error: -j has to be a whole number.\n");
+			return -1;
+		}
+		try {
+			runner.run(parser.lex(prelude));
+			runner.freezeDefinitions();
+		} catch (std::exception &e) {
+			printf("Prelude.charm nonexistant or unopenable. This shouldn't ever happen! Please report it to the charm devs.\n");
+			printf("Error: %s\n\n", e.what());
+			return -1;
+		}
+		Server server(*serveOpt, parser, runner, limits, workers);
+		return server.serve();
+	}
+
+	//every argument that's left is an input file
+	std::vector<std::string> fileNames = args;
+	//if there's a batch of files to run, load the prelude once and copy it for each of them
+	if (fileNames.size() > 1 || (jobsOpt && fileNames.size() > 0)) {
+		unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+		try {
+			if (jobsOpt) {
+				jobs = std::max(1, std::stoi(*jobsOpt));
+			}
+		} catch (std::exception &e) {
+			printf("Error: -j has to be a whole number.\n");
+			return -1;
+		}
+		try {
+			runner.run(parser.lex(prelude));
+			runner.freezeDefinitions();
+		} catch (std::exception &e) {
+			printf("Prelude.charm nonexistant or unopenable. This shouldn't ever happen! Please report it to the charm devs.\n");
+			printf("Error: %s\n\n", e.what());
+			return -1;
+		}
+		Batch batch(fileNames, parser, runner, limits);
+		return batch.run(jobs, json);
+	}
+
 	//if theres a file to run, load it and run it
 	if (optFileName) {
 		//first, load the prelude
 		try {
 			//load up the Prelude.charm file
 			runner.run(parser.lex(prelude));
+			//it doesn't change after this, so it can go where lookups are fast
+			runner.freezeDefinitions();
 		} catch (std::exception &e) {
 			printf("Prelude.charm nonexistant or unopenable. This shouldn't ever happen! Please report it to the charm devs.\n");
 			printf("Error: %s\n\n", e.what());
 			return -1;
 		}
+		//(so that the allocation statistics are just the input file's)
+		CharmPool::Statistics poolBefore = CharmPool::statistics();
 		try {
+			//only profile the input file, not the prelude
+			if (profileFileOpt) {
+				runner.profiler = &profiler;
+			}
+			runner.setLimits(limits);
 			std::string line;
 			std::ifstream inFile(*optFileName);
 			while (std::getline(inFile, line)) {
 				runner.run(parser.lex(line));
 			}
 		} catch (std::exception &e) {
+			//(what the program printed before it stopped goes first)
+			standardOutput().flush();
 			printf("%s nonexistant or unopenable.\n", (*optFileName).c_str());
 			printf("Error: %s\n", e.what());
 			return -1;
 		}
+		if (profileFileOpt) {
+			standardOutput().flush();
+			fprintf(stderr, "Most run sequences (superinstruction candidates):\n");
+			for (const auto& sequence : profiler.topSequences(10)) {
+				fprintf(stderr, "    %llu: %s\n", sequence.second, sequence.first.c_str());
+			}
+			try {
+				profiler.writeProfile(*profileFileOpt);
+			} catch (std::exception &e) {
+				printf("Error: %s\n", e.what());
+				return -1;
+			}
+		}
+		//report how the memoized functions did
+		if (runner.getMemoCaches().size() > 0) {
+			standardOutput().flush();
+			fprintf(stderr, "Memoization statistics:\n");
+			for (const auto& cache : runner.getMemoCaches()) {
+				fprintf(stderr, "    %s: %llu hits, %llu misses, %llu evictions\n",
+					cache.first.c_str(), cache.second.hits, cache.second.misses, cache.second.evictions);
+			}
+		}
+		if (allocStats) {
+			CharmPool::Statistics poolAfter = CharmPool::statistics();
+			unsigned long long allocations = poolAfter.allocations - poolBefore.allocations;
+			unsigned long long reused = poolAfter.reused - poolBefore.reused;
+			standardOutput().flush();
+			fprintf(stderr, "Allocation statistics:\n");
+			fprintf(stderr, "    %llu blocks from the pool, %llu of them reused (%.1f%%)\n",
+				allocations, reused, allocations > 0 ? 100.0 * reused / allocations : 0.0);
+			fprintf(stderr, "    %llu bytes taken from the heap\n", poolAfter.heapBytes - poolBefore.heapBytes);
+		}
   	} else {
 		printf("Charm Interpreter v%s\n", VERSION.c_str());
 		printf("Made by @Aearnus\n");
@@ -145,12 +458,16 @@ int main(int argc, char const *argv[]) {
 		try {
 			//load up the Prelude.charm file
 			runner.run(parser.lex(prelude));
+			//it doesn't change after this, so it can go where lookups are fast
+			runner.freezeDefinitions();
 			printf("Prelude.charm loaded.\n");
 		} catch (std::exception &e) {
 			printf("Prelude.charm nonexistant or unopenable. This shouldn't ever happen! Please report it to the charm devs.\n");
 			printf("Error: %s\n\n", e.what());
 			return -1;
 		}
+		//(the REPL's own messages and what the programs print go through different buffers)
+		fflush(stdout);
 		try {
 			//if one was supplied, load up an extra interactive file
 			if (interactiveFileOpt) {
@@ -159,22 +476,25 @@ int main(int argc, char const *argv[]) {
 				while (std::getline(interactiveFile, line)) {
 					runner.run(parser.lex(line));
 				}
+				standardOutput().flush();
 				printf("%s loaded.\n", (*interactiveFileOpt).c_str());
 			}
 		} catch (std::exception &e) {
+			standardOutput().flush();
 			printf("%s nonexistant or unopenable.\n", (*interactiveFileOpt).c_str());
 			printf("Error: %s\n", e.what());
 			return -1;
 		}
 #ifdef CHARM_GUI
 		// start up the GUI if there isn't a file to run
-		charm_gui_init(parser, runner);
+		charm_gui_init(parser, runner, limits);
 #else
 		//begin the interactive loop if there isnt a file to run
+		completionRunner = &runner;
+		rl_attempted_completion_function = completeFunctionName;
 		while (true) {
-			std::stringstream prompt;
-			prompt << "Charm (Stack " << charmFunctionToString(runner.getCurrentStack()->name) << ")$ ";
-			std::string codeInput(readline(prompt.str().c_str()));
+			std::string prompt = "Charm (Stack " + charmFunctionToString(runner.getCurrentStack()->name, PREVIEW_LIMITS) + ")$ ";
+			std::string codeInput(readline(prompt.c_str()));
 			add_history(codeInput.c_str());
 			auto parsedProgram = parser.lex(codeInput);
 			ONLYDEBUG printf("TOKEN TYPES: ");
@@ -183,11 +503,15 @@ int main(int argc, char const *argv[]) {
 			}
 			ONLYDEBUG printf("\n");
 			try {
+				runner.setLimits(limits);
 				runner.run(parsedProgram);
 			} catch (const std::runtime_error& e) {
+				standardOutput().flush();
 				printf("ERRROR: %s\n", e.what());
 				//return -1;
 			}
+			standardOutput().flush();
+			fflush(stdout);
 			ONLYDEBUG printf("THE STACK (just the types): ");
 			CHARM_STACK_TYPE postStack = runner.getCurrentStack()->stack;
 			ONLYDEBUG printf("\n");
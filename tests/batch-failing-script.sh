@@ -0,0 +1,11 @@
+# a script that fails in a batch reports its own error, and the ones around it still run
+charm=$1
+first=${TMPDIR:-/tmp}/charm-test-$$-first.charm
+last=${TMPDIR:-/tmp}/charm-test-$$-last.charm
+echo '1 2 + p newline' > "$first"
+echo '6 7 * p newline' > "$last"
+# (the summary on stderr has the timings in it, which change from run to run)
+$charm -j 2 "$first" "$2" "$last" 2>/dev/null
+status=$?
+rm -f "$first" "$last"
+exit $status
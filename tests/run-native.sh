@@ -0,0 +1,35 @@
+#!/bin/sh
+# builds every tests/*.charm into a native executable (see `make program.native`) and compares what
+# it prints, and the exit code it ends with, to the .out file next to it, the same as run.sh does for
+# the interpreter. the tests with a .args or .sh are about charm's command line, and are left out
+charm=${1:-./charm}
+make=${2:-make}
+dir=$(dirname "$0")
+failed=0
+for test in "$dir"/*.charm; do
+	name=${test%.charm}
+	if [ -f "$name.args" ] || [ -f "$name.sh" ]; then
+		continue
+	fi
+	# (a program that doesn't get past analysis fails here, with what running it would say)
+	emitted=$($charm --emit-cpp "$name.native.cpp" "$test" 2>&1)
+	status=$?
+	if [ $status = 0 ]; then
+		if ! $make -s "$name.native" >/dev/null; then
+			echo "FAILED: $test (didn't build)"
+			failed=1
+			continue
+		fi
+		got=$("$name.native" 2>&1; echo "exit $?")
+	else
+		got=$(printf '%s\nexit %s' "$emitted" $status)
+	fi
+	rm -f "$name.native" "$name.native.cpp"
+	if [ "$got" != "$(cat "$name.out")" ]; then
+		echo "FAILED: $test"
+		echo "$got" | diff "$name.out" - | head -20
+		failed=1
+	fi
+done
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
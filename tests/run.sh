@@ -0,0 +1,28 @@
+#!/bin/sh
+# runs every tests/*.charm with the charm binary given (./charm by default) and compares what it
+# prints, and the exit code it ends with, to the .out file next to it. a .args file next to a test
+# holds the command line to run it with instead, where the script is `%`. and a .sh next to a test
+# runs instead of charm, as `sh <test>.sh <charm> <test>.charm`, for the tests that need more than one
+charm=${1:-./charm}
+dir=$(dirname "$0")
+failed=0
+for test in "$dir"/*.charm; do
+	name=${test%.charm}
+	if [ -f "$name.sh" ]; then
+		got=$(sh "$name.sh" "$charm" "$test" 2>&1; echo "exit $?")
+	else
+		if [ -f "$name.args" ]; then
+			args=$(sed "s|%|$test|g" "$name.args")
+		else
+			args=$test
+		fi
+		got=$($charm $args 2>&1; echo "exit $?")
+	fi
+	if [ "$got" != "$(cat "$name.out")" ]; then
+		echo "FAILED: $test"
+		echo "$got" | diff "$name.out" - | head -20
+		failed=1
+	fi
+done
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
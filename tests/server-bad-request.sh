@@ -0,0 +1,20 @@
+# a request that fails has to leave the server running for the next one
+charm=$1
+socket=${TMPDIR:-/tmp}/charm-test-$$.sock
+rm -f "$socket"
+$charm --serve "$socket" -j 1 >/dev/null 2>&1 &
+server=$!
+tries=0
+while [ ! -S "$socket" ] && [ $tries -lt 50 ]; do
+	sleep 0.1
+	tries=$((tries + 1))
+done
+# (the timings the client prints to stderr change from run to run)
+$charm --client "$socket" "$2" 2>/dev/null
+echo "first request: exit $?"
+good=${TMPDIR:-/tmp}/charm-test-$$.charm
+echo '6 7 * p newline' > "$good"
+$charm --client "$socket" "$good" 2>/dev/null
+echo "second request: exit $?"
+kill $server
+rm -f "$socket" "$good"